@@ -6,5 +6,9 @@
 /* Define Driver version */
 #define DREAMFOCUSER_VERSION_MAJOR @DREAMFOCUSER_VERSION_MAJOR@
 #define DREAMFOCUSER_VERSION_MINOR @DREAMFOCUSER_VERSION_MINOR@
+/* Count heap allocations made during polling */
+#cmakedefine DREAMFOCUSER_ALLOC_CHECK
+/* Inject link faults on request and measure the recovery */
+#cmakedefine DREAMFOCUSER_FAULT_INJECTION
 
 #endif // CONFIG_H
@@ -29,8 +29,15 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <libgen.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <termios.h>
 #include <memory>
+#include <atomic>
 #include <indicom.h>
 
 #include "dreamfocuser.h"
@@ -88,11 +95,187 @@ response - MG00000z
 #define PARK_PARK 0
 #define PARK_UNPARK 1
 
+#define PROFILE_AUTO 0
+#define PROFILE_FULL 1
+#define PROFILE_REDUCED 2
+
+#define STATUS_VCC12V 3
+
+#define GROUP_LEADER 0
+#define GROUP_MEMBERS 1
+
+#define GROUP_MOVE_OFFSET 0
+#define GROUP_MOVE_SEQUENCE 1
+
+#define LINK_DEPTH 0
+#define LINK_RTT 1
+#define LINK_DROPS 2
+#define LINK_REJECTED 3
+#define LINK_POLL 4
+
+#define POLL_STATUS 0
+#define POLL_POSITION 1
+#define POLL_TEMPERATURE 2
+#define POLL_MAXPOS 3
+#define POLL_FIELDS DREAMFOCUSER_POLL_FIELDS
+
+#define TICKLESS_ENABLE 0
+#define TICKLESS_DISABLE 1
+
+#define TICKLESS_GRACE 0
+#define TICKLESS_KEEPALIVE 1
+
+#define POSITION_AT_TIME 0
+#define POSITION_AT_POSITION 1
+
+#define METRIC_CAMERA 0
+#define METRIC_BLOB 1
+
+#define METRIC_HFR 0
+#define METRIC_STARS 1
+#define METRIC_POSITION 2
+#define METRIC_DURATION 3
+
+#define BACKLASH_START 0
+#define BACKLASH_ABORT 1
+
+#define BACKLASH_SPAN 0
+#define BACKLASH_STEP 1
+#define BACKLASH_MAX 2
+
+#define SETTLE_FIXED 0
+#define SETTLE_LEARNED 1
+
+#define SETTLE_SAMPLES 0
+#define SETTLE_PERIOD 1
+#define SETTLE_TIME 2
+
+#define READY_TIME 0
+#define READY_POSITION 1
+#define READY_SETTLE 2
+
+#define THERMAL_WINDOW 0
+#define THERMAL_THRESHOLD 1
+
+#define THERMAL_SLOPE 0
+#define THERMAL_FORECAST 1
+#define THERMAL_EQUILIBRIUM_AT 2
+
+#define DRIFT_OFF 0
+#define DRIFT_SIGNAL 1
+#define DRIFT_REFOCUS 2
+
+#define DRIFT_BASELINE 0
+#define DRIFT_ALLOWANCE 1
+#define DRIFT_THRESHOLD 2
+#define DRIFT_STEP 3
+
+#define DRIFT_HFR 0
+#define DRIFT_SIGMA 1
+#define DRIFT_CUSUM 2
+#define DRIFT_FRAMES 3
+
+#define JOURNAL_ENABLE 0
+#define JOURNAL_DISABLE 1
+
+#define PACKED_ENABLE 0
+#define PACKED_DISABLE 1
+
+#define PACKED_TIME 0
+#define PACKED_POSITION 1
+#define PACKED_TARGET 2
+#define PACKED_FLAGS 3
+#define PACKED_TEMPERATURE 4
+#define PACKED_HUMIDITY 5
+#define PACKED_DEW_POINT 6
+
+#define PARK_MEMORY_POSITION 0
+#define PARK_MEMORY_TEMPERATURE 1
+#define PARK_MEMORY_VALID 2
+#define PARK_SOURCE_INTERNAL "internal"
+
+#define CURVE_OFF 0
+#define CURVE_COLLECT 1
+
+#define CURVE_POSITION 0
+#define CURVE_LOW 1
+#define CURVE_HIGH 2
+#define CURVE_HFR 3
+#define CURVE_MODEL 4
+#define CURVE_INLIERS 5
+#define CURVE_SAMPLES 6
+#define CURVE_DURATION 7
+
+#define FAULT_ALL FAULT_CLASSES
+#define FAULT_RECOVERY 0
+#define FAULT_LOST_POLLS 1
+#define FAULT_LOST_UPDATES 2
+
+#define WEATHER_DEVICE 0
+#define WEATHER_TEMPERATURE 1
+#define WEATHER_HUMIDITY 2
+
+#define WEATHER_CHECK_PERIOD 0
+#define WEATHER_STALE 1
+#define WEATHER_TOLERANCE 2
+
+#define SENSOR_TEMPERATURE 0
+#define SENSOR_HUMIDITY 1
+#define SENSOR_DIFFERENCE 2
+
 // We declare an auto pointer to DreamFocuser.
 static std::unique_ptr<DreamFocuser> dreamFocuser(new DreamFocuser());
 
 void ISPoll(void *p);
 
+#ifdef DREAMFOCUSER_ALLOC_CHECK
+// Counting allocator. Once connected, a tick must not allocate: the driver
+// runs for months on small boards where allocator churn shows up as latency
+// spikes. The executable's malloc interposes the C library's for libindi as
+// well, so property publication and the event loop timers are counted too,
+// and operator new ends up here through libstdc++.
+static std::atomic<unsigned long> allocationCount(0);
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t n, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+
+    void *malloc(size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t n, size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(n, size);
+    }
+
+    void *realloc(void *p, size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(p, size);
+    }
+}
+#endif
+
+static double wallclock()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000. + ts.tv_nsec / 1e6;
+}
+
 void ISGetProperties(const char *dev)
 {
     dreamFocuser->ISGetProperties(dev);
@@ -143,6 +326,95 @@ DreamFocuser::DreamFocuser()
     isMoving = false;
     isParked = 0;
     isVcc12V = false;
+    moveInProgress = false;
+    targetPosition = 0;
+    finalPosition = 0;
+    segmentPosition = 0;
+    moveRetries = 0;
+    groupMoveActive = false;
+    groupSequence = 0;
+    leaderSequence = -1;
+    groupMembers = 0;
+    pipelineDepth = 1;
+    responseStatus = RESPONSE_OK;
+    schedulerTimerID = -1;
+    moveSpeed = DREAMFOCUSER_DEFAULT_SPEED;
+    moveStartTime = 0;
+    moveSeenTime = 0;
+    moveStartPosition = 0;
+    idleMode = false;
+    lastActivity = 0;
+    wakeups = 0;
+    inTick = false;
+    packedDue = false;
+    allocatingTicks = tickAllocations = 0;
+    allocationWarning = -DREAMFOCUSER_STATS_PERIOD;
+    hotplugFD = -1;
+    hotplugWatch = -1;
+    hotplugCallbackID = -1;
+    statsStartTime = 0;
+    statsStartCPU = 0;
+    historyStart = 0;
+    historyCount = 0;
+    pendingHead = 0;
+    pendingCount = 0;
+    metricHFR = 0;
+    metricTime = 0;
+    metricPosition = 0;
+    frameAtRest = false;
+    backlashState = BACKLASH_IDLE;
+    backlashReference = 0;
+    backlashSteps = 0;
+    backlashReferenceHFR = 0;
+    backlashPreviousHFR = 0;
+    settling = false;
+    settleSamples = 0;
+    settlePosition = 0;
+    settleStopTime = 0;
+    settleLastChange = 0;
+    learnedSettle = -1;
+    settleStopWall = 0;
+    restWall = 0;
+    restFrameSeen = false;
+    settleFrames = 0;
+    thermalStart = 0;
+    thermalCount = 0;
+    driftPosition = 0;
+    driftFrames = 0;
+    driftSum = 0;
+    driftSumSquares = 0;
+    driftCusum = 0;
+    refocusState = REFOCUS_IDLE;
+    refocusCenter = 0;
+    refocusCenterHFR = 0;
+    refocusLowHFR = 0;
+    packedSinceKey = DREAMFOCUSER_KEYFRAME;
+    resumePending = false;
+    faultClass = -1;
+    unreadCount = 0;
+    externalWeather = false;
+    weatherResolved = true;
+    externalTemperature = 0;
+    externalHumidity = NAN;
+    faultSequence = false;
+    faultRemaining = 0;
+    faultStart = 0;
+    faultLostPolls = 0;
+    faultLostUpdates = 0;
+    for (int i = 0; i < DREAMFOCUSER_PACKED_FIELDS; i++)
+        packedLast[i] = 0;
+    for (int i = 0; i < LINK_ERRORS; i++)
+    {
+        suppressedErrors[i] = 0;
+        errorReported[i] = false;
+    }
+    pollDue = 0;
+    pollFields = 0;
+    pollCount = 0;
+    pollNext = 0;
+    interactiveStreak = 0;
+    moveGeneration = 0;
+    pollMoveGeneration = 0;
 
     setVersion(DREAMFOCUSER_VERSION_MAJOR, DREAMFOCUSER_VERSION_MINOR);
 
@@ -187,7 +459,246 @@ bool DreamFocuser::initProperties()
     IUFillSwitch(&StatusS[0], "ABSOLUTE", "Absolute", ISS_OFF);
     IUFillSwitch(&StatusS[1], "MOVING", "Moving", ISS_OFF);
     IUFillSwitch(&StatusS[2], "PARKED", "Parked", ISS_OFF);
-    IUFillSwitchVector(&StatusSP, StatusS, 3, getDeviceName(), "STATUS", "Status", MAIN_CONTROL_TAB, IP_RO, ISR_NOFMANY, 0, IPS_IDLE);
+    IUFillSwitch(&StatusS[STATUS_VCC12V], "VCC12V", "12V supply", ISS_OFF);
+    IUFillSwitchVector(&StatusSP, StatusS, 4, getDeviceName(), "STATUS", "Status", MAIN_CONTROL_TAB, IP_RO, ISR_NOFMANY, 0, IPS_IDLE);
+
+    // Motion profile, reduced profile is used on low supply voltage to avoid stalls
+    IUFillSwitch(&MotionProfileS[PROFILE_AUTO], "AUTO", "Auto", ISS_ON);
+    IUFillSwitch(&MotionProfileS[PROFILE_FULL], "FULL", "Full speed", ISS_OFF);
+    IUFillSwitch(&MotionProfileS[PROFILE_REDUCED], "REDUCED", "Reduced", ISS_OFF);
+    IUFillSwitchVector(&MotionProfileSP, MotionProfileS, 3, getDeviceName(), "MOTION_PROFILE", "Motion profile", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&MotionProfileN[0], "SEGMENT", "Reduced segment [steps]", "%.f", DREAMFOCUSER_STEP_SIZE, 100000, DREAMFOCUSER_STEP_SIZE, DREAMFOCUSER_SEGMENT_SIZE);
+    IUFillNumber(&MotionProfileN[1], "RETRIES", "Stall retries", "%.f", 0, 10, 1, DREAMFOCUSER_STALL_RETRIES);
+    IUFillNumberVector(&MotionProfileNP, MotionProfileN, 2, getDeviceName(), "MOTION_PROFILE_SETTINGS", "Reduced profile", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Coordinated moves with other focusers. Followers snoop the leader's group move,
+    // the leader snoops the members to learn when the last one has arrived.
+    IUFillText(&GroupT[GROUP_LEADER], "LEADER", "Follow device", "");
+    IUFillText(&GroupT[GROUP_MEMBERS], "MEMBERS", "Member devices", "");
+    IUFillTextVector(&GroupTP, GroupT, 2, getDeviceName(), "FOCUS_GROUP", "Focuser group", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&GroupMoveN[GROUP_MOVE_OFFSET], "OFFSET", "Offset [steps]", "%.f", -100000, 100000, DREAMFOCUSER_STEP_SIZE, 0);
+    IUFillNumber(&GroupMoveN[GROUP_MOVE_SEQUENCE], "SEQUENCE", "Sequence", "%.f", 0, 1e9, 1, 0);
+    IUFillNumberVector(&GroupMoveNP, GroupMoveN, 2, getDeviceName(), "FOCUS_GROUP_MOVE", "Group move", MAIN_CONTROL_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&SnoopGroupMoveN[GROUP_MOVE_OFFSET], "OFFSET", "Offset [steps]", "%.f", -100000, 100000, DREAMFOCUSER_STEP_SIZE, 0);
+    IUFillNumber(&SnoopGroupMoveN[GROUP_MOVE_SEQUENCE], "SEQUENCE", "Sequence", "%.f", 0, 1e9, 1, 0);
+    IUFillNumberVector(&SnoopGroupMoveNP, SnoopGroupMoveN, 2, "", "FOCUS_GROUP_MOVE", "Group move", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Link self-test, picks pipeline depth and polling period for this unit and cable
+    IUFillSwitch(&LinkTestS[0], "RUN", "Run", ISS_OFF);
+    IUFillSwitchVector(&LinkTestSP, LinkTestS, 1, getDeviceName(), "LINK_TEST", "Link test", OPTIONS_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&LinkTestN[LINK_DEPTH], "DEPTH", "Pipeline depth", "%.f", 1, DREAMFOCUSER_MAX_PIPELINE, 1, 1);
+    IUFillNumber(&LinkTestN[LINK_RTT], "RTT", "Round trip [ms]", "%.2f", 0, 10000, 0, 0);
+    IUFillNumber(&LinkTestN[LINK_DROPS], "DROPS", "Dropped", "%.f", 0, 1e6, 0, 0);
+    IUFillNumber(&LinkTestN[LINK_REJECTED], "ERRORS", "Rejected", "%.f", 0, 1e6, 0, 0);
+    IUFillNumber(&LinkTestN[LINK_POLL], "POLL", "Safe polling [ms]", "%.f", 0, 60000, 0, 0);
+    IUFillNumberVector(&LinkTestNP, LinkTestN, 5, getDeviceName(), "LINK_TEST_RESULT", "Link test result", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Polling periods of the individual fields
+    IUFillNumber(&PollPeriodN[POLL_STATUS], "STATUS", "Status [ms]", "%.f", 50, 600000, 50, 500);
+    IUFillNumber(&PollPeriodN[POLL_POSITION], "POSITION", "Position [ms]", "%.f", 50, 600000, 50, 500);
+    IUFillNumber(&PollPeriodN[POLL_TEMPERATURE], "TEMPERATURE", "Temperature [ms]", "%.f", 50, 600000, 50, 2000);
+    IUFillNumber(&PollPeriodN[POLL_MAXPOS], "MAXPOSITION", "Max position [ms]", "%.f", 50, 600000, 50, 5000);
+    IUFillNumberVector(&PollPeriodNP, PollPeriodN, POLL_FIELDS, getDeviceName(), "POLL_PERIODS", "Polling", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Tickless idle, polling backs off to a keep-alive while nothing is going on
+    IUFillSwitch(&TicklessS[TICKLESS_ENABLE], "ENABLE", "Enable", ISS_ON);
+    IUFillSwitch(&TicklessS[TICKLESS_DISABLE], "DISABLE", "Disable", ISS_OFF);
+    IUFillSwitchVector(&TicklessSP, TicklessS, 2, getDeviceName(), "TICKLESS_IDLE", "Tickless idle", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&TicklessN[TICKLESS_GRACE], "GRACE", "Idle after [s]", "%.f", 1, 3600, 1, 10);
+    IUFillNumber(&TicklessN[TICKLESS_KEEPALIVE], "KEEPALIVE", "Keep-alive [s]", "%.f", 1, 3600, 1, 30);
+    IUFillNumberVector(&TicklessNP, TicklessN, 2, getDeviceName(), "TICKLESS_SETTINGS", "Idle polling", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&WakeupStatsN[0], "WAKEUPS", "Wakeups [1/s]", "%.3f", 0, 1000, 0, 0);
+    IUFillNumber(&WakeupStatsN[1], "CPU", "CPU [s/h]", "%.3f", 0, 3600, 0, 0);
+    IUFillNumberVector(&WakeupStatsNP, WakeupStatsN, 2, getDeviceName(), "WAKEUP_STATS", "Wakeups", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Serial link error counters, repeated errors are only summarized in the log
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_WRITE], "WRITE", "Write", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_TIMEOUT], "TIMEOUT", "Timeout", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_SHORT], "SHORT", "Short read", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_CHECKSUM], "CHECKSUM", "Response checksum", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_UNKNOWN_COMMAND], "UNKNOWN_COMMAND", "Unrecognized command", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_BAD_CHECKSUM], "BAD_CHECKSUM", "Command checksum", "%.f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkErrorsN[LINK_ERROR_STALE], "STALE", "Stale reply", "%.f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&LinkErrorsNP, LinkErrorsN, LINK_ERRORS, getDeviceName(), "LINK_ERRORS", "Link errors", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Position lookup by time, a client sets TIME (UNIX seconds) and gets the position back
+    IUFillNumber(&PositionAtN[POSITION_AT_TIME], "TIME", "Time [s]", "%.3f", 0, 1e10, 0, 0);
+    IUFillNumber(&PositionAtN[POSITION_AT_POSITION], "POSITION", "Position", "%.1f", -1e9, 1e9, 0, 0);
+    IUFillNumberVector(&PositionAtNP, PositionAtN, 2, getDeviceName(), "FOCUS_POSITION_AT", "Position at time", MAIN_CONTROL_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Focus metric measured from a snooped camera image
+    IUFillText(&MetricSourceT[METRIC_CAMERA], "CAMERA", "Camera device", "");
+    IUFillText(&MetricSourceT[METRIC_BLOB], "BLOB", "Image property", "CCD1");
+    IUFillTextVector(&MetricSourceTP, MetricSourceT, 2, getDeviceName(), "FOCUS_METRIC_SOURCE", "Focus metric", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&FocusMetricN[METRIC_HFR], "HFR", "HFR [px]", "%.2f", 0, 1000, 0, 0);
+    IUFillNumber(&FocusMetricN[METRIC_STARS], "STARS", "Stars", "%.f", 0, 1e6, 0, 0);
+    IUFillNumber(&FocusMetricN[METRIC_POSITION], "POSITION", "Position", "%.f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&FocusMetricN[METRIC_DURATION], "DURATION", "Analysis [ms]", "%.1f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&FocusMetricNP, FocusMetricN, 4, getDeviceName(), "FOCUS_METRIC", "Focus metric", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    IUFillBLOB(&SnoopImageB[0], "CCD1", "Image", "");
+    IUFillBLOBVector(&SnoopImageBP, SnoopImageB, 1, "", "CCD1", "Image", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Backlash, moves inward overshoot by this amount so the final approach is always outward
+    IUFillNumber(&SetBacklashN[0], "FOCUS_BACKLASH_VALUE", "Backlash [steps]", "%.f", 0, 10000, 1, 0);
+    IUFillNumberVector(&SetBacklashNP, SetBacklashN, 1, getDeviceName(), "FOCUS_BACKLASH_STEPS", "Backlash", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Backlash measurement from the focus metric
+    IUFillSwitch(&BacklashMeasureS[BACKLASH_START], "START", "Start", ISS_OFF);
+    IUFillSwitch(&BacklashMeasureS[BACKLASH_ABORT], "ABORT", "Abort", ISS_OFF);
+    IUFillSwitchVector(&BacklashMeasureSP, BacklashMeasureS, 2, getDeviceName(), "FOCUS_BACKLASH_MEASURE", "Measure backlash", FOCUS_SETTINGS_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&BacklashMeasureN[BACKLASH_SPAN], "SPAN", "Approach span [steps]", "%.f", 1, 100000, DREAMFOCUSER_STEP_SIZE, 20 * DREAMFOCUSER_STEP_SIZE);
+    IUFillNumber(&BacklashMeasureN[BACKLASH_STEP], "STEP", "Probe step [steps]", "%.f", 1, 10000, 1, DREAMFOCUSER_STEP_SIZE / 2);
+    IUFillNumber(&BacklashMeasureN[BACKLASH_MAX], "MAX", "Max backlash [steps]", "%.f", 1, 100000, DREAMFOCUSER_STEP_SIZE, 10 * DREAMFOCUSER_STEP_SIZE);
+    IUFillNumberVector(&BacklashMeasureNP, BacklashMeasureN, 3, getDeviceName(), "FOCUS_BACKLASH_MEASURE_SETTINGS", "Backlash measurement", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Settling, the motor stopping is not the optics holding still
+    IUFillSwitch(&SettleS[SETTLE_FIXED], "FIXED", "Fixed", ISS_ON);
+    IUFillSwitch(&SettleS[SETTLE_LEARNED], "LEARNED", "Learned", ISS_OFF);
+    IUFillSwitchVector(&SettleSP, SettleS, 2, getDeviceName(), "FOCUS_SETTLE_MODE", "Settle time", FOCUS_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&SettleN[SETTLE_SAMPLES], "SAMPLES", "Still samples", "%.f", 1, 20, 1, 3);
+    IUFillNumber(&SettleN[SETTLE_PERIOD], "PERIOD", "Sample period [ms]", "%.f", DREAMFOCUSER_MIN_POLL, 5000, 10, DREAMFOCUSER_MIN_POLL);
+    IUFillNumber(&SettleN[SETTLE_TIME], "TIME", "Settle time [ms]", "%.f", 0, 60000, 50, 250);
+    IUFillNumberVector(&SettleNP, SettleN, 3, getDeviceName(), "FOCUS_SETTLE", "Settling", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Ready for exposure, BUSY while moving or settling and OK with the time it became ready
+    IUFillNumber(&ReadyN[READY_TIME], "TIME", "Ready since [s]", "%.3f", 0, 1e10, 0, 0);
+    IUFillNumber(&ReadyN[READY_POSITION], "POSITION", "Position", "%.f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&ReadyN[READY_SETTLE], "SETTLE", "Settled in [ms]", "%.f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&ReadyNP, ReadyN, 3, getDeviceName(), "FOCUS_READY", "Ready", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Thermal equilibrium from the temperature history
+    IUFillNumber(&ThermalN[THERMAL_WINDOW], "WINDOW", "Window [min]", "%.f", 2, DREAMFOCUSER_THERMAL_SIZE * DREAMFOCUSER_THERMAL_SPACING / 60, 1, 15);
+    IUFillNumber(&ThermalN[THERMAL_THRESHOLD], "THRESHOLD", "Equilibrium below [C/h]", "%.2f", 0.01, 100, 0.1, 0.5);
+    IUFillNumberVector(&ThermalNP, ThermalN, 2, getDeviceName(), "FOCUS_THERMAL_SETTINGS", "Thermal equilibrium", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // OK in equilibrium, BUSY while the temperature still drifts, IDLE until the window has filled
+    IUFillNumber(&ThermalStateN[THERMAL_SLOPE], "SLOPE", "Slope [C/h]", "%.2f", -1000, 1000, 0, 0);
+    IUFillNumber(&ThermalStateN[THERMAL_FORECAST], "FORECAST", "Equilibrium in [min]", "%.1f", -1, 1e6, 0, -1);
+    IUFillNumber(&ThermalStateN[THERMAL_EQUILIBRIUM_AT], "EQUILIBRIUM_AT", "Equilibrium at [s]", "%.f", 0, 1e10, 0, 0);
+    IUFillNumberVector(&ThermalStateNP, ThermalStateN, 3, getDeviceName(), "FOCUS_THERMAL", "Thermal", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Focus drift monitor on the focus metric
+    IUFillSwitch(&DriftS[DRIFT_OFF], "OFF", "Off", ISS_ON);
+    IUFillSwitch(&DriftS[DRIFT_SIGNAL], "SIGNAL", "Signal", ISS_OFF);
+    IUFillSwitch(&DriftS[DRIFT_REFOCUS], "REFOCUS", "Refocus", ISS_OFF);
+    IUFillSwitchVector(&DriftSP, DriftS, 3, getDeviceName(), "FOCUS_DRIFT_MODE", "Drift monitor", FOCUS_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&DriftN[DRIFT_BASELINE], "BASELINE", "Baseline frames", "%.f", 2, 100, 1, 5);
+    IUFillNumber(&DriftN[DRIFT_ALLOWANCE], "ALLOWANCE", "Allowance [sigma]", "%.2f", 0, 5, 0.1, 0.5);
+    IUFillNumber(&DriftN[DRIFT_THRESHOLD], "THRESHOLD", "Threshold [sigma]", "%.2f", 0.5, 50, 0.5, 5);
+    IUFillNumber(&DriftN[DRIFT_STEP], "STEP", "Refocus step [steps]", "%.f", 1, 100000, DREAMFOCUSER_STEP_SIZE, 4 * DREAMFOCUSER_STEP_SIZE);
+    IUFillNumberVector(&DriftNP, DriftN, 4, getDeviceName(), "FOCUS_DRIFT_SETTINGS", "Drift monitor", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // IDLE while building the baseline, OK in focus, ALERT on drift, BUSY while refocusing
+    IUFillNumber(&DriftStateN[DRIFT_HFR], "HFR", "Baseline HFR [px]", "%.2f", 0, 1000, 0, 0);
+    IUFillNumber(&DriftStateN[DRIFT_SIGMA], "SIGMA", "Baseline sigma [px]", "%.3f", 0, 1000, 0, 0);
+    IUFillNumber(&DriftStateN[DRIFT_CUSUM], "CUSUM", "Drift [sigma]", "%.2f", 0, 1e6, 0, 0);
+    IUFillNumber(&DriftStateN[DRIFT_FRAMES], "FRAMES", "Frames", "%.f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&DriftStateNP, DriftStateN, 4, getDeviceName(), "FOCUS_DRIFT", "Focus drift", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Event journal, read with dreamfocuser_analyze
+    IUFillSwitch(&JournalS[JOURNAL_ENABLE], "ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&JournalS[JOURNAL_DISABLE], "DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&JournalSP, JournalS, 2, getDeviceName(), "FOCUS_JOURNAL", "Journal", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillText(&JournalT[0], "FILE", "File", "/tmp/dreamfocuser.journal");
+    IUFillTextVector(&JournalTP, JournalT, 1, getDeviceName(), "FOCUS_JOURNAL_FILE", "Journal", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Packed status snapshot for thin clients, see README for the format
+    IUFillSwitch(&PackedStatusS[PACKED_ENABLE], "ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&PackedStatusS[PACKED_DISABLE], "DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&PackedStatusSP, PackedStatusS, 2, getDeviceName(), "FOCUS_PACKED_STATUS_MODE", "Packed status", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillBLOB(&PackedStatusB[0], "STATUS", "Status", ".dfs");
+    IUFillBLOBVector(&PackedStatusBP, PackedStatusB, 1, getDeviceName(), "FOCUS_PACKED_STATUS", "Packed status", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Position and temperature before the last park, kept in the config across restarts
+    IUFillNumber(&ParkMemoryN[PARK_MEMORY_POSITION], "POSITION", "Position", "%.f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&ParkMemoryN[PARK_MEMORY_TEMPERATURE], "TEMPERATURE", "Temperature [C]", "%.1f", -100, 100, 0, 0);
+    IUFillNumber(&ParkMemoryN[PARK_MEMORY_VALID], "VALID", "Valid", "%.f", 0, 1, 1, 0);
+    IUFillNumberVector(&ParkMemoryNP, ParkMemoryN, 3, getDeviceName(), "FOCUS_PARK_MEMORY", "Park memory", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+    // The weather device the park temperature came from, or PARK_SOURCE_INTERNAL for the focuser's sensor
+    IUFillText(&ParkSourceT[0], "SOURCE", "Temperature source", PARK_SOURCE_INTERNAL);
+    IUFillTextVector(&ParkSourceTP, ParkSourceT, 1, getDeviceName(), "FOCUS_PARK_SOURCE", "Park temperature", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&TempCompensationN[0], "COEFFICIENT", "Steps per C", "%.1f", -10000, 10000, 1, 0);
+    IUFillNumberVector(&TempCompensationNP, TempCompensationN, 1, getDeviceName(), "FOCUS_TEMPERATURE_COMPENSATION", "Temperature compensation", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillSwitch(&ResumeS[0], "RESUME", "Unpark and resume", ISS_OFF);
+    IUFillSwitchVector(&ResumeSP, ResumeS, 1, getDeviceName(), "FOCUS_RESUME", "Resume", MAIN_CONTROL_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    // Focus curve fitted to the frames of a sweep
+    IUFillSwitch(&FocusCurveS[CURVE_OFF], "OFF", "Off", ISS_ON);
+    IUFillSwitch(&FocusCurveS[CURVE_COLLECT], "COLLECT", "Collect", ISS_OFF);
+    IUFillSwitchVector(&FocusCurveSP, FocusCurveS, 2, getDeviceName(), "FOCUS_CURVE_MODE", "Focus curve", MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&FocusCurveMoveS[0], "MOVE", "Move to best", ISS_OFF);
+    IUFillSwitchVector(&FocusCurveMoveSP, FocusCurveMoveS, 1, getDeviceName(), "FOCUS_CURVE_MOVE", "Best focus", MAIN_CONTROL_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&FocusCurveN[0], "OUTLIER", "Outlier above [px]", "%.2f", 0.01, 100, 0.1, 0.5);
+    IUFillNumberVector(&FocusCurveNP, FocusCurveN, 1, getDeviceName(), "FOCUS_CURVE_SETTINGS", "Focus curve", FOCUS_SETTINGS_TAB, IP_RW, 0, IPS_IDLE);
+
+    // MODEL is 0 parabola, 1 hyperbola, 2 asymmetric hyperbola
+    IUFillNumber(&FocusCurveResultN[CURVE_POSITION], "POSITION", "Best focus", "%.1f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_LOW], "LOW", "95% low", "%.1f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_HIGH], "HIGH", "95% high", "%.1f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_HFR], "HFR", "HFR [px]", "%.2f", 0, 1000, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_MODEL], "MODEL", "Model", "%.f", 0, 2, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_INLIERS], "INLIERS", "Inliers", "%.f", 0, FOCUSCURVE_MAX_SAMPLES, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_SAMPLES], "SAMPLES", "Samples", "%.f", 0, FOCUSCURVE_MAX_SAMPLES, 0, 0);
+    IUFillNumber(&FocusCurveResultN[CURVE_DURATION], "DURATION", "Fit [ms]", "%.2f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&FocusCurveResultNP, FocusCurveResultN, 8, getDeviceName(), "FOCUS_CURVE", "Focus curve", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Fault injection, offered only in DREAMFOCUSER_FAULT_INJECTION builds
+    const char *faultNames[FAULT_CLASSES + 1] = { "DROP", "CHECKSUM", "UNKNOWN_COMMAND", "BAD_CHECKSUM", "STALL", "PORT", "ALL" };
+    const char *faultLabels[FAULT_CLASSES + 1] = { "Dropped bytes", "Checksum", "'!' reply", "'?' reply", "Stall", "Port lost", "All" };
+    for (int i = 0; i <= FAULT_CLASSES; i++)
+        IUFillSwitch(&FaultS[i], faultNames[i], faultLabels[i], ISS_OFF);
+    IUFillSwitchVector(&FaultSP, FaultS, FAULT_CLASSES + 1, getDeviceName(), "FOCUS_FAULT_INJECT", "Inject fault", OPTIONS_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    IUFillNumber(&FaultN[0], "RESPONSES", "Faulty responses", "%.f", 1, 100, 1, 3);
+    IUFillNumberVector(&FaultNP, FaultN, 1, getDeviceName(), "FOCUS_FAULT_SETTINGS", "Fault injection", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    for (int i = 0; i < FAULT_CLASSES; i++)
+    {
+        char name[MAXINDINAME], label[MAXINDILABEL];
+        snprintf(name, MAXINDINAME, "%s_RECOVERY", faultNames[i]);
+        snprintf(label, MAXINDILABEL, "%s recovery [ms]", faultLabels[i]);
+        IUFillNumber(&FaultResultsN[3 * i + FAULT_RECOVERY], name, label, "%.f", 0, 1e9, 0, 0);
+        snprintf(name, MAXINDINAME, "%s_POLLS", faultNames[i]);
+        snprintf(label, MAXINDILABEL, "%s lost polls", faultLabels[i]);
+        IUFillNumber(&FaultResultsN[3 * i + FAULT_LOST_POLLS], name, label, "%.f", 0, 1e9, 0, 0);
+        snprintf(name, MAXINDINAME, "%s_UPDATES", faultNames[i]);
+        snprintf(label, MAXINDILABEL, "%s lost updates", faultLabels[i]);
+        IUFillNumber(&FaultResultsN[3 * i + FAULT_LOST_UPDATES], name, label, "%.f", 0, 1e9, 0, 0);
+    }
+    IUFillNumberVector(&FaultResultsNP, FaultResultsN, 3 * FAULT_CLASSES, getDeviceName(), "FOCUS_FAULT_RESULTS", "Fault recovery", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+    // Ambient temperature and humidity from the WEATHER_PARAMETERS of a weather device
+    IUFillText(&WeatherSourceT[WEATHER_DEVICE], "DEVICE", "Weather device", "");
+    IUFillText(&WeatherSourceT[WEATHER_TEMPERATURE], "TEMPERATURE", "Temperature element", "WEATHER_TEMPERATURE");
+    IUFillText(&WeatherSourceT[WEATHER_HUMIDITY], "HUMIDITY", "Humidity element", "WEATHER_HUMIDITY");
+    IUFillTextVector(&WeatherSourceTP, WeatherSourceT, 3, getDeviceName(), "FOCUS_WEATHER_SOURCE", "Weather source", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&WeatherCheckN[WEATHER_CHECK_PERIOD], "PERIOD", "Sensor check [s]", "%.f", 10, 86400, 10, 600);
+    IUFillNumber(&WeatherCheckN[WEATHER_STALE], "STALE", "Source lost after [s]", "%.f", 10, 86400, 10, 300);
+    IUFillNumber(&WeatherCheckN[WEATHER_TOLERANCE], "TOLERANCE", "Disagreement [C]", "%.1f", 0, 50, 0.5, 3);
+    IUFillNumberVector(&WeatherCheckNP, WeatherCheckN, 3, getDeviceName(), "FOCUS_WEATHER_CHECK", "Weather source", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&SensorN[SENSOR_TEMPERATURE], "TEMPERATURE", "Temperature [C]", "%6.1f", -100, 100, 0, 0);
+    IUFillNumber(&SensorN[SENSOR_HUMIDITY], "HUMIDITY", "Humidity [%]", "%6.1f", 0, 100, 0, 0);
+    IUFillNumber(&SensorN[SENSOR_DIFFERENCE], "DIFFERENCE", "Above source [C]", "%6.1f", -200, 200, 0, 0);
+    IUFillNumberVector(&SensorNP, SensorN, 3, getDeviceName(), "FOCUS_SENSOR", "Focuser sensor", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
 
     //    PresetN[0].min = PresetN[1].min = PresetN[2].min = FocusAbsPosN[0].min = -MaxPositionN[0].value;
     //    PresetN[0].max = PresetN[1].max = PresetN[2].max = FocusAbsPosN[0].max = MaxPositionN[0].value;
@@ -222,15 +733,109 @@ bool DreamFocuser::updateProperties()
         defineSwitch(&ParkSP);
         defineNumber(&WeatherNP);
         defineSwitch(&StatusSP);
+        defineSwitch(&MotionProfileSP);
+        defineNumber(&MotionProfileNP);
+        defineNumber(&GroupMoveNP);
+        defineText(&GroupTP);
+        defineSwitch(&LinkTestSP);
+        defineNumber(&LinkTestNP);
+        defineNumber(&PollPeriodNP);
+        defineSwitch(&TicklessSP);
+        defineNumber(&TicklessNP);
+        defineNumber(&WakeupStatsNP);
+        defineNumber(&LinkErrorsNP);
+        defineNumber(&PositionAtNP);
+        defineText(&MetricSourceTP);
+        defineNumber(&FocusMetricNP);
+        defineNumber(&SetBacklashNP);
+        defineSwitch(&BacklashMeasureSP);
+        defineNumber(&BacklashMeasureNP);
+        defineSwitch(&SettleSP);
+        defineNumber(&SettleNP);
+        defineNumber(&ReadyNP);
+        defineNumber(&ThermalNP);
+        defineNumber(&ThermalStateNP);
+        defineSwitch(&DriftSP);
+        defineNumber(&DriftNP);
+        defineNumber(&DriftStateNP);
+        defineSwitch(&JournalSP);
+        defineText(&JournalTP);
+        defineSwitch(&PackedStatusSP);
+        defineNumber(&ParkMemoryNP);
+        defineText(&ParkSourceTP);
+        defineNumber(&TempCompensationNP);
+        defineSwitch(&ResumeSP);
+        defineSwitch(&FocusCurveSP);
+        defineSwitch(&FocusCurveMoveSP);
+        defineNumber(&FocusCurveNP);
+        defineNumber(&FocusCurveResultNP);
+        defineBLOB(&PackedStatusBP);
+        defineText(&WeatherSourceTP);
+        defineNumber(&WeatherCheckNP);
+        defineNumber(&SensorNP);
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+        defineSwitch(&FaultSP);
+        defineNumber(&FaultNP);
+        defineNumber(&FaultResultsNP);
+#endif
+        startScheduler();
         //defineNumber(&MaxPositionNP);
         //defineNumber(&MaxTravelNP);
     }
     else
     {
+        resumePending = false;
+        ResumeSP.s = IPS_IDLE;
         //deleteProperty(SyncSP.name);
         deleteProperty(ParkSP.name);
         deleteProperty(WeatherNP.name);
         deleteProperty(StatusSP.name);
+        deleteProperty(MotionProfileSP.name);
+        deleteProperty(MotionProfileNP.name);
+        deleteProperty(GroupMoveNP.name);
+        deleteProperty(GroupTP.name);
+        deleteProperty(LinkTestSP.name);
+        deleteProperty(LinkTestNP.name);
+        deleteProperty(PollPeriodNP.name);
+        deleteProperty(TicklessSP.name);
+        deleteProperty(TicklessNP.name);
+        deleteProperty(WakeupStatsNP.name);
+        deleteProperty(LinkErrorsNP.name);
+        deleteProperty(PositionAtNP.name);
+        deleteProperty(MetricSourceTP.name);
+        deleteProperty(FocusMetricNP.name);
+        deleteProperty(SetBacklashNP.name);
+        deleteProperty(BacklashMeasureSP.name);
+        deleteProperty(BacklashMeasureNP.name);
+        deleteProperty(SettleSP.name);
+        deleteProperty(SettleNP.name);
+        deleteProperty(ReadyNP.name);
+        deleteProperty(ThermalNP.name);
+        deleteProperty(ThermalStateNP.name);
+        deleteProperty(DriftSP.name);
+        deleteProperty(DriftNP.name);
+        deleteProperty(DriftStateNP.name);
+        deleteProperty(JournalSP.name);
+        deleteProperty(JournalTP.name);
+        deleteProperty(PackedStatusSP.name);
+        deleteProperty(ParkMemoryNP.name);
+        deleteProperty(ParkSourceTP.name);
+        deleteProperty(TempCompensationNP.name);
+        deleteProperty(ResumeSP.name);
+        deleteProperty(FocusCurveSP.name);
+        deleteProperty(FocusCurveMoveSP.name);
+        deleteProperty(FocusCurveNP.name);
+        deleteProperty(FocusCurveResultNP.name);
+        deleteProperty(PackedStatusBP.name);
+        deleteProperty(WeatherSourceTP.name);
+        deleteProperty(WeatherCheckNP.name);
+        deleteProperty(SensorNP.name);
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+        deleteProperty(FaultSP.name);
+        deleteProperty(FaultNP.name);
+        deleteProperty(FaultResultsNP.name);
+#endif
+        stopScheduler();
         //deleteProperty(MaxPositionNP.name);
         //deleteProperty(MaxTravelNP.name);
     }
@@ -251,6 +856,315 @@ void DreamFocuser::ISGetProperties(const char *dev)
 */
 
 
+bool DreamFocuser::saveConfigItems(FILE *fp)
+{
+    INDI::Focuser::saveConfigItems(fp);
+
+    IUSaveConfigSwitch(fp, &MotionProfileSP);
+    IUSaveConfigNumber(fp, &MotionProfileNP);
+    IUSaveConfigText(fp, &GroupTP);
+    IUSaveConfigNumber(fp, &PollPeriodNP);
+    IUSaveConfigSwitch(fp, &TicklessSP);
+    IUSaveConfigNumber(fp, &TicklessNP);
+    IUSaveConfigText(fp, &MetricSourceTP);
+    IUSaveConfigNumber(fp, &SetBacklashNP);
+    IUSaveConfigNumber(fp, &BacklashMeasureNP);
+    IUSaveConfigSwitch(fp, &SettleSP);
+    IUSaveConfigNumber(fp, &SettleNP);
+    IUSaveConfigNumber(fp, &ThermalNP);
+    IUSaveConfigSwitch(fp, &DriftSP);
+    IUSaveConfigNumber(fp, &DriftNP);
+    IUSaveConfigSwitch(fp, &JournalSP);
+    IUSaveConfigText(fp, &JournalTP);
+    IUSaveConfigSwitch(fp, &PackedStatusSP);
+    IUSaveConfigNumber(fp, &ParkMemoryNP);
+    IUSaveConfigText(fp, &ParkSourceTP);
+    IUSaveConfigNumber(fp, &TempCompensationNP);
+    IUSaveConfigNumber(fp, &FocusCurveNP);
+    IUSaveConfigText(fp, &WeatherSourceTP);
+    IUSaveConfigNumber(fp, &WeatherCheckNP);
+
+    return true;
+}
+
+bool DreamFocuser::ISNewNumber (const char *dev, const char *name, double values[], char *names[], int n)
+{
+    if(strcmp(dev, getDeviceName()) == 0)
+    {
+        // Tickless idle settings, applied from the next idle period
+        if (!strcmp(TicklessNP.name, name))
+        {
+            IUUpdateNumber(&TicklessNP, values, names, n);
+            wakeUp();
+            TicklessNP.s = IPS_OK;
+            IDSetNumber(&TicklessNP, nullptr);
+            return true;
+        }
+
+        // Reduced motion profile settings
+        if (!strcmp(MotionProfileNP.name, name))
+        {
+            IUUpdateNumber(&MotionProfileNP, values, names, n);
+            MotionProfileNP.s = IPS_OK;
+            IDSetNumber(&MotionProfileNP, nullptr);
+            return true;
+        }
+
+        // Backlash
+        if (!strcmp(SetBacklashNP.name, name))
+        {
+            IUUpdateNumber(&SetBacklashNP, values, names, n);
+            SetBacklashNP.s = IPS_OK;
+            IDSetNumber(&SetBacklashNP, nullptr);
+            return true;
+        }
+
+        // Backlash measurement settings
+        if (!strcmp(BacklashMeasureNP.name, name))
+        {
+            IUUpdateNumber(&BacklashMeasureNP, values, names, n);
+            BacklashMeasureNP.s = IPS_OK;
+            IDSetNumber(&BacklashMeasureNP, nullptr);
+            return true;
+        }
+
+        // Settle settings
+        if (!strcmp(SettleNP.name, name))
+        {
+            IUUpdateNumber(&SettleNP, values, names, n);
+            SettleNP.s = IPS_OK;
+            IDSetNumber(&SettleNP, nullptr);
+            return true;
+        }
+
+        // Thermal equilibrium settings
+        if (!strcmp(ThermalNP.name, name))
+        {
+            IUUpdateNumber(&ThermalNP, values, names, n);
+            ThermalNP.s = IPS_OK;
+            IDSetNumber(&ThermalNP, nullptr);
+            updateThermal();
+            return true;
+        }
+
+        // Drift monitor settings
+        if (!strcmp(DriftNP.name, name))
+        {
+            IUUpdateNumber(&DriftNP, values, names, n);
+            DriftNP.s = IPS_OK;
+            IDSetNumber(&DriftNP, nullptr);
+            return true;
+        }
+
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+        // Fault injection settings
+        if (!strcmp(FaultNP.name, name))
+        {
+            IUUpdateNumber(&FaultNP, values, names, n);
+            FaultNP.s = IPS_OK;
+            IDSetNumber(&FaultNP, nullptr);
+            return true;
+        }
+#endif
+
+        // Park memory, set by parking but editable
+        if (!strcmp(ParkMemoryNP.name, name))
+        {
+            IUUpdateNumber(&ParkMemoryNP, values, names, n);
+            ParkMemoryNP.s = IPS_OK;
+            IDSetNumber(&ParkMemoryNP, nullptr);
+            return true;
+        }
+
+        // Temperature compensation
+        if (!strcmp(TempCompensationNP.name, name))
+        {
+            IUUpdateNumber(&TempCompensationNP, values, names, n);
+            TempCompensationNP.s = IPS_OK;
+            IDSetNumber(&TempCompensationNP, nullptr);
+            return true;
+        }
+
+        // Focus curve settings
+        if (!strcmp(FocusCurveNP.name, name))
+        {
+            IUUpdateNumber(&FocusCurveNP, values, names, n);
+            FocusCurveNP.s = IPS_OK;
+            IDSetNumber(&FocusCurveNP, nullptr);
+            return true;
+        }
+
+        // Position history lookup
+        if (!strcmp(PositionAtNP.name, name))
+        {
+            double position;
+
+            IUUpdateNumber(&PositionAtNP, values, names, n);
+            if ( positionAt(PositionAtN[POSITION_AT_TIME].value, &position) )
+            {
+                PositionAtN[POSITION_AT_POSITION].value = position;
+                PositionAtNP.s = IPS_OK;
+            }
+            else
+            {
+                LOGF_WARN("No position history at %.3f.", PositionAtN[POSITION_AT_TIME].value);
+                PositionAtNP.s = IPS_ALERT;
+            }
+            IDSetNumber(&PositionAtNP, nullptr);
+            return true;
+        }
+
+        // Weather source checks, a new sensor check period applies right away
+        if (!strcmp(WeatherCheckNP.name, name))
+        {
+            IUUpdateNumber(&WeatherCheckNP, values, names, n);
+            if ( isConnected() && externalWeather )
+            {
+                schedule(&pollTask[POLL_TEMPERATURE].task, pollPeriod(POLL_TEMPERATURE), pollPeriod(POLL_TEMPERATURE));
+                schedule(&weatherStaleTask, WeatherCheckN[WEATHER_STALE].value * 1000);
+            }
+            WeatherCheckNP.s = IPS_OK;
+            IDSetNumber(&WeatherCheckNP, nullptr);
+            return true;
+        }
+
+        // Polling periods
+        if (!strcmp(PollPeriodNP.name, name))
+        {
+            IUUpdateNumber(&PollPeriodNP, values, names, n);
+            applySafePolling();
+            PollPeriodNP.s = IPS_OK;
+            IDSetNumber(&PollPeriodNP, nullptr);
+            return true;
+        }
+
+        // Group move, this device leads
+        if (!strcmp(GroupMoveNP.name, name))
+        {
+            double offset = 0;
+            for (int i = 0; i < n; i++)
+                if (!strcmp(names[i], GroupMoveN[GROUP_MOVE_OFFSET].name))
+                    offset = values[i];
+            startGroupMove(offset, GroupMoveN[GROUP_MOVE_SEQUENCE].value + 1);
+            return true;
+        }
+    }
+
+    return INDI::Focuser::ISNewNumber(dev, name, values, names, n);
+}
+
+bool DreamFocuser::ISNewText (const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    if(strcmp(dev, getDeviceName()) == 0)
+    {
+        // Focuser group
+        if (!strcmp(GroupTP.name, name))
+        {
+            IUUpdateText(&GroupTP, texts, names, n);
+            updateGroup();
+            GroupTP.s = IPS_OK;
+            IDSetText(&GroupTP, nullptr);
+            return true;
+        }
+
+        // Focus metric source
+        if (!strcmp(MetricSourceTP.name, name))
+        {
+            IUUpdateText(&MetricSourceTP, texts, names, n);
+            updateMetricSource();
+            MetricSourceTP.s = IPS_OK;
+            IDSetText(&MetricSourceTP, nullptr);
+            return true;
+        }
+
+        // Park temperature source, set together with the park memory
+        if (!strcmp(ParkSourceTP.name, name))
+        {
+            IUUpdateText(&ParkSourceTP, texts, names, n);
+            ParkSourceTP.s = IPS_OK;
+            IDSetText(&ParkSourceTP, nullptr);
+            return true;
+        }
+
+        // Weather source
+        if (!strcmp(WeatherSourceTP.name, name))
+        {
+            IUUpdateText(&WeatherSourceTP, texts, names, n);
+            updateWeatherSource();
+            WeatherSourceTP.s = IPS_OK;
+            IDSetText(&WeatherSourceTP, nullptr);
+            return true;
+        }
+
+        // Journal file, an open journal moves to the new file
+        if (!strcmp(JournalTP.name, name))
+        {
+            IUUpdateText(&JournalTP, texts, names, n);
+            JournalTP.s = IPS_OK;
+            IDSetText(&JournalTP, nullptr);
+            updateJournal();
+            return true;
+        }
+    }
+
+    return INDI::Focuser::ISNewText(dev, name, texts, names, n);
+}
+
+bool DreamFocuser::ISSnoopDevice (XMLEle *root)
+{
+    const char *dev = findXMLAttValu(root, "device");
+
+    // Ambient temperature and humidity
+    if ( WeatherSourceT[WEATHER_DEVICE].text[0] != '\0' && !strcmp(dev, WeatherSourceT[WEATHER_DEVICE].text) &&
+            !strcmp(findXMLAttValu(root, "name"), "WEATHER_PARAMETERS") )
+    {
+        snoopWeather(root);
+        return true;
+    }
+
+    // Camera image for the focus metric
+    if ( MetricSourceT[METRIC_CAMERA].text[0] != '\0' && !strcmp(dev, MetricSourceT[METRIC_CAMERA].text) )
+    {
+        strncpy(SnoopImageBP.device, dev, MAXINDINAME - 1);
+        if ( IUSnoopBLOB(root, &SnoopImageBP) == 0 )
+        {
+            FocusMetricNP.s = measureImage(&SnoopImageB[0]) ? IPS_OK : IPS_ALERT;
+            IDSetNumber(&FocusMetricNP, nullptr);
+            free(SnoopImageB[0].blob);
+            SnoopImageB[0].blob = nullptr;
+            SnoopImageB[0].bloblen = 0;
+            return true;
+        }
+    }
+
+    strncpy(SnoopGroupMoveNP.device, dev, MAXINDINAME - 1);
+    if ( IUSnoopNumber(root, &SnoopGroupMoveNP) == 0 )
+    {
+        int sequence = SnoopGroupMoveN[GROUP_MOVE_SEQUENCE].value;
+
+        // Leader announced a new group move
+        if ( !strcmp(dev, GroupT[GROUP_LEADER].text) )
+        {
+            if ( (SnoopGroupMoveNP.s == IPS_BUSY) && (sequence != leaderSequence) )
+            {
+                LOGF_INFO("Group move %d from %s, offset %.f.", sequence, dev, SnoopGroupMoveN[GROUP_MOVE_OFFSET].value);
+                startGroupMove(SnoopGroupMoveN[GROUP_MOVE_OFFSET].value, sequence);
+            }
+            leaderSequence = sequence;
+        }
+
+        // Member progress on the group move we lead
+        for (int i = 0; i < groupMembers; i++)
+            if ( groupMoveActive && (sequence == groupSequence) && !strcmp(dev, groupMember[i]) )
+                groupMemberState[i] = SnoopGroupMoveNP.s;
+
+        checkGroupMove();
+        return true;
+    }
+
+    return INDI::Focuser::ISSnoopDevice(root);
+}
+
 //bool DreamFocuser::saveConfigItems(FILE *fp)
 //{
 //    INDI::Focuser::saveConfigItems(fp);
@@ -319,6 +1233,16 @@ bool DreamFocuser::ISNewSwitch (const char *dev, const char *name, ISState *stat
 {
     if(strcmp(dev, getDeviceName()) == 0)
     {
+        // Tickless idle
+        if (!strcmp(TicklessSP.name, name))
+        {
+            IUUpdateSwitch(&TicklessSP, states, names, n);
+            wakeUp();
+            TicklessSP.s = IPS_OK;
+            IDSetSwitch(&TicklessSP, nullptr);
+            return true;
+        }
+
         // Park
         if (!strcmp(ParkSP.name, name))
         {
@@ -329,6 +1253,8 @@ bool DreamFocuser::ISNewSwitch (const char *dev, const char *name, ISState *stat
             if ( (isParked && (index == PARK_UNPARK)) || ( !isParked && (index == PARK_PARK)) )
             {
                 LOG_INFO("Park, issuing command.");
+                if ( !isParked )
+                    rememberPark();
                 if ( setPark() )
                 {
                     //ParkSP.s = IPS_OK;
@@ -341,6 +1267,156 @@ bool DreamFocuser::ISNewSwitch (const char *dev, const char *name, ISState *stat
             IDSetSwitch(&ParkSP, nullptr);
             return true;
         }
+
+        // Unpark and return to the position held before parking
+        if (!strcmp(ResumeSP.name, name))
+        {
+            IUResetSwitch(&ResumeSP);
+            ResumeSP.s = startResume() ? IPS_BUSY : IPS_ALERT;
+            IDSetSwitch(&ResumeSP, nullptr);
+            return true;
+        }
+
+        // Focus curve collection, starting it drops the previous sweep
+        if (!strcmp(FocusCurveSP.name, name))
+        {
+            IUUpdateSwitch(&FocusCurveSP, states, names, n);
+            if ( FocusCurveS[CURVE_COLLECT].s == ISS_ON )
+            {
+                focusCurve.clear();
+                FocusCurveResultN[CURVE_SAMPLES].value = 0;
+                FocusCurveResultNP.s = IPS_IDLE;
+                IDSetNumber(&FocusCurveResultNP, nullptr);
+            }
+            FocusCurveSP.s = FocusCurveS[CURVE_COLLECT].s == ISS_ON ? IPS_BUSY : IPS_IDLE;
+            IDSetSwitch(&FocusCurveSP, nullptr);
+            return true;
+        }
+
+        // Move to the fitted best focus
+        if (!strcmp(FocusCurveMoveSP.name, name))
+        {
+            IUResetSwitch(&FocusCurveMoveSP);
+            double position = FocusCurveResultN[CURVE_POSITION].value;
+            if ( FocusCurveResultNP.s != IPS_OK )
+                FocusCurveMoveSP.s = IPS_ALERT;
+            else if ( (position < FocusAbsPosN[0].min) || (position > FocusAbsPosN[0].max) )
+            {
+                LOGF_ERROR("Best focus %.f is outside the focuser range, extend the sweep.", position);
+                FocusCurveMoveSP.s = IPS_ALERT;
+            }
+            else if ( MoveAbsFocuser(lround(position)) == IPS_OK )
+            {
+                LOGF_INFO("Moving to best focus %.f.", position);
+                FocusCurveMoveSP.s = IPS_OK;
+                FocusAbsPosNP.s = IPS_BUSY;
+                IDSetNumber(&FocusAbsPosNP, nullptr);
+            }
+            else
+                FocusCurveMoveSP.s = IPS_ALERT;
+            IDSetSwitch(&FocusCurveMoveSP, nullptr);
+            return true;
+        }
+
+        // Motion profile
+        if (!strcmp(MotionProfileSP.name, name))
+        {
+            IUUpdateSwitch(&MotionProfileSP, states, names, n);
+            MotionProfileSP.s = IPS_OK;
+            LOGF_INFO("Motion profile: %s, using %s speed.", IUFindOnSwitch(&MotionProfileSP)->label, isReducedProfile() ? "reduced" : "full");
+            IDSetSwitch(&MotionProfileSP, nullptr);
+            return true;
+        }
+
+        // Settle time mode
+        if (!strcmp(SettleSP.name, name))
+        {
+            IUUpdateSwitch(&SettleSP, states, names, n);
+            SettleSP.s = IPS_OK;
+            IDSetSwitch(&SettleSP, nullptr);
+            return true;
+        }
+
+        // Drift monitor mode, a new mode starts from a fresh baseline
+        if (!strcmp(DriftSP.name, name))
+        {
+            IUUpdateSwitch(&DriftSP, states, names, n);
+            DriftSP.s = IPS_OK;
+            IDSetSwitch(&DriftSP, nullptr);
+            refocusState = REFOCUS_IDLE;
+            resetDrift();
+            return true;
+        }
+
+        // Packed status, a new subscriber starts from a full snapshot
+        if (!strcmp(PackedStatusSP.name, name))
+        {
+            IUUpdateSwitch(&PackedStatusSP, states, names, n);
+            PackedStatusSP.s = PackedStatusS[PACKED_ENABLE].s == ISS_ON ? IPS_OK : IPS_IDLE;
+            packedSinceKey = DREAMFOCUSER_KEYFRAME;
+            if ( isConnected() && (PackedStatusS[PACKED_ENABLE].s == ISS_ON) )
+                schedule(&packedKeyTask, 0, DREAMFOCUSER_KEYFRAME_PERIOD);
+            else
+                scheduler.cancel(&packedKeyTask);
+            IDSetSwitch(&PackedStatusSP, nullptr);
+            return true;
+        }
+
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+        // Fault injection
+        if (!strcmp(FaultSP.name, name))
+        {
+            IUUpdateSwitch(&FaultSP, states, names, n);
+            int index = IUFindOnSwitchIndex(&FaultSP);
+            IUResetSwitch(&FaultSP);
+            if ( (index >= 0) && (faultClass < 0) )
+            {
+                faultSequence = index == FAULT_ALL;
+                startFault(faultSequence ? 0 : index);
+            }
+            IDSetSwitch(&FaultSP, nullptr);
+            return true;
+        }
+#endif
+
+        // Journal
+        if (!strcmp(JournalSP.name, name))
+        {
+            IUUpdateSwitch(&JournalSP, states, names, n);
+            updateJournal();
+            return true;
+        }
+
+        // Backlash measurement
+        if (!strcmp(BacklashMeasureSP.name, name))
+        {
+            IUUpdateSwitch(&BacklashMeasureSP, states, names, n);
+            int index = IUFindOnSwitchIndex(&BacklashMeasureSP);
+            IUResetSwitch(&BacklashMeasureSP);
+
+            if ( index == BACKLASH_START && backlashState == BACKLASH_IDLE )
+                BacklashMeasureSP.s = startBacklashMeasurement() ? IPS_BUSY : IPS_ALERT;
+            else if ( index == BACKLASH_ABORT && backlashState != BACKLASH_IDLE )
+            {
+                LOG_INFO("Backlash measurement aborted.");
+                stopBacklashMeasurement(IPS_IDLE);
+                AbortFocuser();
+                return true;
+            }
+            IDSetSwitch(&BacklashMeasureSP, nullptr);
+            return true;
+        }
+
+        // Link self-test
+        if (!strcmp(LinkTestSP.name, name))
+        {
+            LinkTestNP.s = runLinkTest() ? IPS_OK : IPS_ALERT;
+            LinkTestSP.s = LinkTestNP.s;
+            IUResetSwitch(&LinkTestSP);
+            IDSetNumber(&LinkTestNP, nullptr);
+            IDSetSwitch(&LinkTestSP, nullptr);
+            return true;
+        }
     }
 
     return INDI::Focuser::ISNewSwitch(dev, name, states, names, n);
@@ -356,38 +1432,72 @@ bool DreamFocuser::SyncFocuser(uint32_t ticks)
 **
 *****************************************************************/
 
-bool DreamFocuser::getTemperature()
+void DreamFocuser::decodeTemperature(const DreamFocuserCommand &r)
 {
-    if ( dispatch_command('T') )
-    {
-        currentTemperature = ((short int)( (currentResponse.c << 8) | currentResponse.d )) / 10.;
-        currentHumidity = ((short int)( (currentResponse.a << 8) | currentResponse.b )) / 10.;
-    }
-    else
-        return false;
-    return true;
+    currentTemperature = ((short int)( (r.c << 8) | r.d )) / 10.;
+    currentHumidity = ((short int)( (r.a << 8) | r.b )) / 10.;
 }
 
-bool DreamFocuser::Handshake()
+void DreamFocuser::decodeStatus(const DreamFocuserCommand &r)
 {
-    return getStatus();
+    isMoving = ( r.d & 3 ) != 0 ? true : false;
+    if ( isMoving )
+        moveSeenTime = TimerWheel::now();
+    //isZero = ( (r.d>>2) & 1 )  == 1;
+    isParked = (r.d>>3) & 3;
+    isVcc12V = ( (r.d>>5) & 1 ) == 1;
 }
 
-bool DreamFocuser::getStatus()
+void DreamFocuser::decodeAbsolute(const DreamFocuserCommand &r)
+{
+    isAbsolute = r.d == 1 ? true : false;
+}
+
+void DreamFocuser::decodePosition(const DreamFocuserCommand &r)
+{
+    currentPosition = (r.a << 24) | (r.b << 16) | (r.c << 8) | r.d;
+}
+
+void DreamFocuser::decodeMaxPosition(const DreamFocuserCommand &r)
+{
+    currentMaxPosition = (r.a << 24) | (r.b << 16) | (r.c << 8) | r.d;
+}
+
+bool DreamFocuser::getTemperature()
+{
+    if ( dispatch_command('T') )
+        decodeTemperature(currentResponse);
+    else
+        return false;
+    return true;
+}
+
+bool DreamFocuser::Handshake()
+{
+    // Nothing sent on an earlier port can answer on this one
+    pendingCount = 0;
+    unreadCount = 0;
+
+    if ( !getStatus() )
+        return false;
+
+    if ( runLinkTest() )
+        LinkTestNP.s = IPS_OK;
+    else
+        LinkTestNP.s = IPS_ALERT;
+    return true;
+}
+
+bool DreamFocuser::getStatus()
 {
     LOG_DEBUG("getStatus.");
     if ( dispatch_command('I') )
-    {
-        isMoving = ( currentResponse.d & 3 ) != 0 ? true : false;
-        //isZero = ( (currentResponse.d>>2) & 1 )  == 1;
-        isParked = (currentResponse.d>>3) & 3;
-        isVcc12V = ( (currentResponse.d>>5) & 1 ) == 1;
-    }
+        decodeStatus(currentResponse);
     else
         return false;
 
     if ( dispatch_command('W') ) // Is absolute?
-        isAbsolute = currentResponse.d == 1 ? true : false;
+        decodeAbsolute(currentResponse);
     else
         return false;
 
@@ -400,7 +1510,7 @@ bool DreamFocuser::getPosition()
     //int32_t pos;
 
     if ( dispatch_command('P') )
-        currentPosition = (currentResponse.a << 24) | (currentResponse.b << 16) | (currentResponse.c << 8) | currentResponse.d;
+        decodePosition(currentResponse);
     else
         return false;
 
@@ -410,20 +1520,265 @@ bool DreamFocuser::getPosition()
 
 bool DreamFocuser::setPosition( int32_t position)
 {
-    if ( dispatch_command('M', position) )
+    if ( dispatch_interactive('M', position) )
         if ( ((currentResponse.a << 24) | (currentResponse.b << 16) | (currentResponse.c << 8) | currentResponse.d) == position )
         {
+            moveGeneration++;
             LOGF_DEBUG("Moving to position %d", position);
             return true;
         };
     return false;
 }
 
+bool DreamFocuser::isReducedProfile()
+{
+    switch (IUFindOnSwitchIndex(&MotionProfileSP))
+    {
+        case PROFILE_FULL:
+            return false;
+        case PROFILE_REDUCED:
+            return true;
+        default:
+            return !isVcc12V;
+    }
+}
+
+bool DreamFocuser::startMove(int32_t position, bool compensate)
+{
+    finalPosition = position;
+
+    // Overshoot inward moves so the gear is always loaded the same way at the end
+    if ( compensate && (SetBacklashN[0].value > 0) && (position < currentPosition) )
+        position -= SetBacklashN[0].value;
+
+    targetPosition = position;
+    moveRetries = 0;
+    startSettle();
+    moveStartTime = moveSeenTime = TimerWheel::now();
+    moveStartPosition = currentPosition;
+    wakeUp();
+    moveInProgress = moveSegment();
+
+    // Check for arrival when the move should be done rather than on the next poll
+    if ( moveInProgress )
+        schedule(&moveEtaTask, abs(position - currentPosition) * 1000. / moveSpeed + DREAMFOCUSER_ETA_MARGIN);
+    return moveInProgress;
+}
+
+// Issue the next leg of the current move. On full profile this is the whole
+// distance; the reduced profile splits it into short segments, which keeps
+// the motor from stalling when it runs from a weak supply.
+bool DreamFocuser::moveSegment()
+{
+    int32_t position = targetPosition;
+
+    if ( isReducedProfile() )
+    {
+        int32_t segment = MotionProfileN[0].value;
+        if ( position > currentPosition + segment )
+            position = currentPosition + segment;
+        else if ( position < currentPosition - segment )
+            position = currentPosition - segment;
+    }
+
+    if ( position != targetPosition )
+        LOGF_DEBUG("Reduced profile, moving segment to %d of %d", position, targetPosition);
+
+    segmentPosition = position;
+    return setPosition(position);
+}
+
+// Called from TimerHit once the position has been refreshed. Continues
+// segmented moves and reissues moves that stopped short of their segment.
+void DreamFocuser::checkMove()
+{
+    if ( !moveInProgress || isMoving )
+        return;
+
+    if ( currentPosition == targetPosition )
+    {
+        // The motor stopped somewhere between the last poll that saw it running and now
+        double noticed = (TimerWheel::now() - moveSeenTime) / 2;
+        double elapsed = TimerWheel::now() - moveStartTime - noticed;
+        int32_t distance = abs(targetPosition - moveStartPosition);
+
+        // Learn the speed from clean moves, it is used to time the arrival check
+        if ( (moveRetries == 0) && (distance >= DREAMFOCUSER_SEGMENT_SIZE) && (elapsed > 0) )
+            moveSpeed = 0.7 * moveSpeed + 0.3 * distance * 1000. / elapsed;
+
+        // Backlash overshoot reached, final outward approach
+        if ( targetPosition != finalPosition )
+        {
+            LOGF_DEBUG("Backlash compensation, approaching %d.", finalPosition);
+            targetPosition = finalPosition;
+            moveRetries = 0;
+            if ( moveSegment() )
+            {
+                FocusAbsPosNP.s = IPS_BUSY;
+                return;
+            }
+            FocusAbsPosNP.s = IPS_ALERT;
+        }
+
+        moveInProgress = false;
+        journal.write(JOURNAL_MOVE, wallclock(), 0, moveRetries, abs(finalPosition - moveStartPosition), TimerWheel::now() - moveStartTime,
+                      (TimerWheel::now() - moveSeenTime) / 2);
+        advanceBacklashMeasurement(false);
+        return;
+    }
+
+    if ( currentPosition != segmentPosition )
+    {
+        if ( moveRetries >= MotionProfileN[1].value )
+        {
+            LOGF_ERROR("Focuser stalled at %d, target %d. Giving up after %d retries.", currentPosition, targetPosition, moveRetries);
+            moveInProgress = false;
+            FocusAbsPosNP.s = IPS_ALERT;
+            if ( backlashState != BACKLASH_IDLE )
+                stopBacklashMeasurement(IPS_ALERT);
+            refocusState = REFOCUS_IDLE;
+            return;
+        }
+        moveRetries++;
+        LOGF_WARN("Focuser stalled at %d, retrying move (%d) on %s speed.", currentPosition, moveRetries, isReducedProfile() ? "reduced" : "full");
+    }
+
+    if ( moveSegment() )
+        FocusAbsPosNP.s = IPS_BUSY;
+    else
+    {
+        moveInProgress = false;
+        FocusAbsPosNP.s = IPS_ALERT;
+    }
+}
+
+void DreamFocuser::updateGroup()
+{
+    char members[DREAMFOCUSER_GROUP_SIZE * MAXINDINAME];
+    char *token, *saveptr, *end;
+
+    leaderSequence = -1;
+    if ( GroupT[GROUP_LEADER].text[0] != '\0' )
+        IDSnoopDevice(GroupT[GROUP_LEADER].text, GroupMoveNP.name);
+
+    groupMembers = 0;
+    strncpy(members, GroupT[GROUP_MEMBERS].text, sizeof(members) - 1);
+    members[sizeof(members) - 1] = '\0';
+
+    for (token = strtok_r(members, ",", &saveptr); token != nullptr; token = strtok_r(nullptr, ",", &saveptr))
+    {
+        while ( *token == ' ' )
+            token++;
+        for (end = token + strlen(token); end > token && end[-1] == ' '; end--)
+            end[-1] = '\0';
+        if ( *token == '\0' )
+            continue;
+        if ( groupMembers == DREAMFOCUSER_GROUP_SIZE )
+        {
+            LOGF_WARN("Too many group members, only %d are used.", DREAMFOCUSER_GROUP_SIZE);
+            break;
+        }
+        strncpy(groupMember[groupMembers], token, MAXINDINAME - 1);
+        groupMember[groupMembers][MAXINDINAME - 1] = '\0';
+        IDSnoopDevice(groupMember[groupMembers], GroupMoveNP.name);
+        groupMembers++;
+    }
+
+    LOGF_DEBUG("Focuser group: leader '%s', %d members.", GroupT[GROUP_LEADER].text, groupMembers);
+}
+
+// Start our part of a group move. The members move on their own serial
+// ports at the same time, so the group takes as long as the slowest one.
+bool DreamFocuser::startGroupMove(int32_t offset, int sequence)
+{
+    groupSequence = sequence;
+    GroupMoveN[GROUP_MOVE_OFFSET].value = offset;
+    GroupMoveN[GROUP_MOVE_SEQUENCE].value = sequence;
+    for (int i = 0; i < groupMembers; i++)
+        groupMemberState[i] = IPS_BUSY;
+
+    if ( isAbsolute == false )
+        LOG_ERROR("Focuser is not in Absolute mode. Please sync.");
+    else if ( isParked != 0 )
+        LOG_ERROR("Please unpark before issuing any motion commands.");
+    else if ( startMove(currentPosition + offset) )
+    {
+        // Members report through snooping only, one that never does must not
+        // hold the group busy, so give up on it after its expected move time.
+        schedule(&groupDeadlineTask, 2 * abs(offset) * 1000. / moveSpeed + DREAMFOCUSER_GROUP_MARGIN);
+        groupMoveActive = true;
+        GroupMoveNP.s = IPS_BUSY;
+        FocusAbsPosNP.s = IPS_BUSY;
+        IDSetNumber(&FocusAbsPosNP, nullptr);
+        IDSetNumber(&GroupMoveNP, nullptr);
+        return true;
+    }
+
+    finishGroupMove(IPS_ALERT);
+    return false;
+}
+
+void DreamFocuser::checkGroupMove()
+{
+    IPState state;
+
+    if ( !groupMoveActive || moveInProgress || isMoving )
+        return;
+
+    state = FocusAbsPosNP.s == IPS_ALERT ? IPS_ALERT : IPS_OK;
+    for (int i = 0; i < groupMembers; i++)
+    {
+        if ( groupMemberState[i] == IPS_BUSY )
+            return;
+        if ( groupMemberState[i] == IPS_ALERT )
+        {
+            LOGF_ERROR("Group member %s failed to move.", groupMember[i]);
+            state = IPS_ALERT;
+        }
+    }
+
+    LOGF_DEBUG("Group move %d complete.", groupSequence);
+    finishGroupMove(state);
+}
+
+void DreamFocuser::finishGroupMove(IPState state)
+{
+    scheduler.cancel(&groupDeadlineTask);
+    groupMoveActive = false;
+    GroupMoveNP.s = state;
+    IDSetNumber(&GroupMoveNP, nullptr);
+}
+
+void DreamFocuser::groupDeadlineHelper(void *context)
+{
+    static_cast<DreamFocuser *>(context)->expireGroupMove();
+}
+
+// The deadline passed with members still busy, they are lost or stuck
+void DreamFocuser::expireGroupMove()
+{
+    if ( !groupMoveActive )
+        return;
+
+    for (int i = 0; i < groupMembers; i++)
+    {
+        if ( groupMemberState[i] != IPS_BUSY )
+            continue;
+        LOGF_ERROR("Group member %s did not finish move %d in time.", groupMember[i], groupSequence);
+        groupMemberState[i] = IPS_ALERT;
+    }
+
+    // Our own move has its own ETA and stall handling, let it end the group
+    if ( moveInProgress || isMoving )
+        return;
+    checkGroupMove();
+}
+
 bool DreamFocuser::getMaxPosition()
 {
     if ( dispatch_command('A', 0, 3) )
     {
-        currentMaxPosition = (currentResponse.a << 24) | (currentResponse.b << 16) | (currentResponse.c << 8) | currentResponse.d;
+        decodeMaxPosition(currentResponse);
         LOGF_DEBUG("getMaxPosition: %d", currentMaxPosition);
         return true;
     }
@@ -436,7 +1791,7 @@ bool DreamFocuser::getMaxPosition()
 
 bool DreamFocuser::setSync( uint32_t position)
 {
-    if ( dispatch_command('Z', position) )
+    if ( dispatch_interactive('Z', position) )
         if ( static_cast<uint32_t>((currentResponse.a << 24) | (currentResponse.b << 16) | (currentResponse.c << 8) | currentResponse.d) == position )
         {
             LOGF_DEBUG("Syncing to position %d", position);
@@ -454,18 +1809,132 @@ bool DreamFocuser::setPark()
         return false;
     }
 
-    if ( dispatch_command('G') )
+    if ( dispatch_interactive('G') )
     {
       LOG_INFO( "Focuser park command.");
+      journal.write(JOURNAL_PARK, wallclock(), 'G', isParked, currentPosition, 0);
       return true;
     }
     LOG_ERROR("Park failed.");
     return false;
 }
 
+// The focuser forgets its position when parked, keep it for the resume
+void DreamFocuser::rememberPark()
+{
+    ParkMemoryN[PARK_MEMORY_POSITION].value = currentPosition;
+    ParkMemoryN[PARK_MEMORY_TEMPERATURE].value = currentTemperature;
+    ParkMemoryN[PARK_MEMORY_VALID].value = 1;
+    ParkMemoryNP.s = IPS_OK;
+    IDSetNumber(&ParkMemoryNP, nullptr);
+    IUSaveText(&ParkSourceT[0], temperatureSource());
+    ParkSourceTP.s = IPS_OK;
+    IDSetText(&ParkSourceTP, nullptr);
+    saveConfig(true, ParkMemoryNP.name);
+    saveConfig(true, ParkSourceTP.name);
+}
+
+const char *DreamFocuser::temperatureSource()
+{
+    return externalWeather ? WeatherSourceT[WEATHER_DEVICE].text : PARK_SOURCE_INTERNAL;
+}
+
+bool DreamFocuser::startResume()
+{
+    if ( ParkMemoryN[PARK_MEMORY_VALID].value == 0 )
+    {
+        LOG_ERROR("No position stored at park, nothing to resume.");
+        return false;
+    }
+
+    // A weather source that has not reported yet gets until it counts as lost
+    resumePending = true;
+    schedule(&resumeTask, DREAMFOCUSER_RESUME_TIMEOUT + (weatherResolved ? 0 : WeatherCheckN[WEATHER_STALE].value * 1000));
+    if ( isParked )
+    {
+        LOG_INFO("Unparking, then resuming the stored position.");
+        if ( !setPark() )
+        {
+            resumePending = false;
+            scheduler.cancel(&resumeTask);
+            return false;
+        }
+        wakeUp();
+        return true;
+    }
+
+    checkResume();
+    return true;
+}
+
+// Once unparked, one move back to the stored position, shifted by the
+// temperature change since parking when compensation is set. Right after
+// connecting the configured weather source has not been heard from yet, the
+// resume waits until it reports or is given up as lost.
+void DreamFocuser::checkResume()
+{
+    if ( !resumePending || isParked || isMoving || moveInProgress || !weatherResolved )
+        return;
+
+    double shift = TempCompensationN[0].value * (currentTemperature - ParkMemoryN[PARK_MEMORY_TEMPERATURE].value);
+
+    // The park and current temperatures are only subtracted when both come from
+    // the same sensor, across two sensors the difference includes their calibration offset
+    if ( (shift != 0) && strcmp(ParkSourceT[0].text, temperatureSource()) )
+    {
+        LOGF_WARN("Temperature at park came from %s, now from %s, resuming without compensation.", ParkSourceT[0].text, temperatureSource());
+        shift = 0;
+    }
+    double position = ParkMemoryN[PARK_MEMORY_POSITION].value + shift;
+
+    LOGF_INFO("Resuming position %.f (stored %.f, %+.f for %.1f C).", position, ParkMemoryN[PARK_MEMORY_POSITION].value, shift,
+              currentTemperature - ParkMemoryN[PARK_MEMORY_TEMPERATURE].value);
+    if ( (position < FocusAbsPosN[0].min) || (position > FocusAbsPosN[0].max) )
+    {
+        position = position < FocusAbsPosN[0].min ? FocusAbsPosN[0].min : FocusAbsPosN[0].max;
+        LOGF_WARN("Resume position is out of range, moving to %.f.", position);
+    }
+
+    if ( MoveAbsFocuser(lround(position)) == IPS_OK )
+    {
+        FocusAbsPosNP.s = IPS_BUSY;
+        IDSetNumber(&FocusAbsPosNP, nullptr);
+        stopResume(IPS_OK);
+    }
+    else
+        stopResume(IPS_ALERT);
+}
+
+void DreamFocuser::stopResume(IPState state)
+{
+    resumePending = false;
+    scheduler.cancel(&resumeTask);
+    ResumeSP.s = state;
+    IDSetSwitch(&ResumeSP, nullptr);
+}
+
+void DreamFocuser::resumeTimeoutHelper(void *context)
+{
+    static_cast<DreamFocuser *>(context)->failResume();
+}
+
+// The focuser never unparked or never came to rest within the deadline
+void DreamFocuser::failResume()
+{
+    LOG_ERROR("Resume failed, the focuser did not become ready to move.");
+    stopResume(IPS_ALERT);
+}
+
 bool DreamFocuser::AbortFocuser()
 {
-    if ( dispatch_command('H') )
+    moveInProgress = false;
+    if ( resumePending )
+        stopResume(IPS_IDLE);
+    if ( backlashState != BACKLASH_IDLE )
+        stopBacklashMeasurement(IPS_IDLE);
+    if ( groupMoveActive )
+        finishGroupMove(IPS_ALERT);
+    if ( dispatch_interactive('H') )
     {
         LOG_INFO("Focusing aborted.");
         return true;
@@ -504,141 +1973,1692 @@ IPState DreamFocuser::MoveAbsFocuser(uint32_t ticks)
 {
     LOGF_DEBUG("MoveAbsPosition: %d", ticks);
 
-    if (isAbsolute == false)
+    if (isAbsolute == false)
+    {
+        LOG_ERROR("Focuser is not in Absolute mode. Please sync.");
+        return IPS_ALERT;
+    }
+
+    if (isParked != 0)
+    {
+        LOG_ERROR("Please unpark before issuing any motion commands.");
+        return IPS_ALERT;
+    }
+    if ( startMove(ticks) )
+    {
+        FocusAbsPosNP.s = IPS_OK;
+        IDSetNumber(&FocusAbsPosNP, nullptr);
+        return IPS_OK;
+    }
+    return IPS_ALERT;
+}
+
+IPState DreamFocuser::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+{
+    int32_t finalTicks = currentPosition + ((int32_t)ticks * (dir == FOCUS_INWARD ? -1 : 1));
+
+    LOGF_DEBUG("MoveRelPosition: %d", finalTicks);
+
+    if (isParked != 0)
+    {
+        LOG_ERROR("Please unpark before issuing any motion commands.");
+        return IPS_ALERT;
+    }
+
+    if ( startMove(finalTicks) )
+    {
+        FocusRelPosNP.s = IPS_OK;
+        IDSetNumber(&FocusRelPosNP, nullptr);
+        return IPS_OK;
+    }
+    return IPS_ALERT;
+}
+
+
+void DreamFocuser::TimerHit()
+{
+    if ( schedulerTimerID != -1 )
+    {
+        RemoveTimer(schedulerTimerID);
+        schedulerTimerID = -1;
+    }
+
+    if ( ! isConnected() )
+        return;
+
+    double start = monotonic_ms();
+    wakeups++;
+
+    // The tasks re-arm the event loop timer once, below, not on every schedule()
+    inTick = true;
+#ifdef DREAMFOCUSER_ALLOC_CHECK
+    unsigned long allocations = allocationCount;
+#endif
+    scheduler.advance();
+#ifdef DREAMFOCUSER_ALLOC_CHECK
+    allocations = allocationCount - allocations;
+#endif
+    inTick = false;
+
+    // Left out of the count: libindi allocates a node for every SetTimer, and
+    // IDSetBLOB an encoding buffer for the packed status
+    armScheduler();
+    if ( packedDue )
+        publishPackedStatus();
+
+#ifdef DREAMFOCUSER_ALLOC_CHECK
+    // The warning allocates itself, so it is given at most once per stats period
+    if ( allocations > 0 )
+    {
+        allocatingTicks++;
+        tickAllocations += allocations;
+        if ( TimerWheel::now() - allocationWarning >= DREAMFOCUSER_STATS_PERIOD )
+        {
+            LOGF_WARN("%lu ticks made %lu heap allocations since connecting.", allocatingTicks, tickAllocations);
+            allocationWarning = TimerWheel::now();
+        }
+    }
+#endif
+
+    if ( journal.isOpen() )
+        journal.write(JOURNAL_TICK, wallclock(), 0, 0, currentPosition, monotonic_ms() - start);
+}
+
+/****************************************************************
+**
+**
+*****************************************************************/
+
+void DreamFocuser::startScheduler()
+{
+    scheduler.start();
+    externalWeather = false;
+    idleMode = false;
+    for (int i = 0; i < POLL_FIELDS; i++)
+    {
+        pollTask[i].focuser = this;
+        pollTask[i].field = i;
+        pollTask[i].task.callback = pollTaskHelper;
+        pollTask[i].task.context = &pollTask[i];
+        scheduler.schedule(&pollTask[i].task, 0, pollPeriod(i));
+    }
+    pollSliceTask.callback = pollSliceHelper;
+    pollSliceTask.context = this;
+    moveEtaTask.callback = moveEtaHelper;
+    moveEtaTask.context = this;
+    groupDeadlineTask.callback = groupDeadlineHelper;
+    groupDeadlineTask.context = this;
+    statsTask.callback = statsHelper;
+    statsTask.context = this;
+    errorSummaryTask.callback = errorSummaryHelper;
+    errorSummaryTask.context = this;
+    reopenTask.callback = reopenHelper;
+    reopenTask.context = this;
+    resumeTask.callback = resumeTimeoutHelper;
+    resumeTask.context = this;
+    settleTask.callback = settleHelper;
+    settleTask.context = this;
+    weatherStaleTask.callback = weatherStaleHelper;
+    weatherStaleTask.context = this;
+    packedKeyTask.callback = packedKeyHelper;
+    packedKeyTask.context = this;
+    // A configured weather source that never reports is lost after the stale time
+    weatherResolved = WeatherSourceT[WEATHER_DEVICE].text[0] == '\0';
+    if ( !weatherResolved )
+        scheduler.schedule(&weatherStaleTask, WeatherCheckN[WEATHER_STALE].value * 1000);
+    scheduler.schedule(&statsTask, DREAMFOCUSER_STATS_PERIOD, DREAMFOCUSER_STATS_PERIOD);
+    if ( PackedStatusS[PACKED_ENABLE].s == ISS_ON )
+        scheduler.schedule(&packedKeyTask, DREAMFOCUSER_KEYFRAME_PERIOD, DREAMFOCUSER_KEYFRAME_PERIOD);
+    pollDue = pollCount = pollNext = 0;
+    allocatingTicks = tickAllocations = 0;
+    settling = false;
+    restWall = 0;
+    lastActivity = TimerWheel::now();
+    updateWakeupStats();
+    startHotplug();
+
+    armScheduler();
+}
+
+void DreamFocuser::stopScheduler()
+{
+    stopHotplug();
+    scheduler.clear();
+    if ( schedulerTimerID != -1 )
+    {
+        RemoveTimer(schedulerTimerID);
+        schedulerTimerID = -1;
+    }
+}
+
+// The event loop holds a single timer, armed to the nearest task deadline
+void DreamFocuser::armScheduler()
+{
+    int64_t delay = scheduler.nextDelay();
+
+    if ( schedulerTimerID != -1 )
+        RemoveTimer(schedulerTimerID);
+    schedulerTimerID = delay < 0 ? -1 : SetTimer(delay);
+}
+
+void DreamFocuser::schedule(TimerWheel::Task *task, uint32_t delay, uint32_t period)
+{
+    scheduler.schedule(task, delay, period);
+    if ( !inTick )
+        armScheduler();
+}
+
+// The configured period is never faster than the safe one measured by the
+// link test. Idle polling backs off to the keep-alive, and with an external
+// weather source the focuser's own sensor is only read for an occasional cross-check
+uint32_t DreamFocuser::pollPeriod(int field)
+{
+    uint32_t period = PollPeriodN[field].value;
+
+    if ( period < LinkTestN[LINK_POLL].value )
+        period = LinkTestN[LINK_POLL].value;
+    if ( idleMode && (period < TicklessN[TICKLESS_KEEPALIVE].value * 1000) )
+        period = TicklessN[TICKLESS_KEEPALIVE].value * 1000;
+    if ( (field == POLL_TEMPERATURE) && externalWeather && (period < WeatherCheckN[WEATHER_CHECK_PERIOD].value * 1000) )
+        period = WeatherCheckN[WEATHER_CHECK_PERIOD].value * 1000;
+    return period;
+}
+
+void DreamFocuser::pollTaskHelper(void *context)
+{
+    PollTask *poll = static_cast<PollTask *>(context);
+
+    poll->focuser->requestPoll(1 << poll->field);
+}
+
+void DreamFocuser::moveEtaHelper(void *context)
+{
+    DreamFocuser *focuser = static_cast<DreamFocuser *>(context);
+
+    focuser->requestPoll((1 << POLL_STATUS) | (1 << POLL_POSITION));
+}
+
+void DreamFocuser::statsHelper(void *context)
+{
+    DreamFocuser *focuser = static_cast<DreamFocuser *>(context);
+
+    focuser->updateWakeupStats();
+    IDSetNumber(&focuser->WakeupStatsNP, nullptr);
+    focuser->journal.flush();
+}
+
+// Publish wakeups per second and CPU time per hour since the last update,
+// the figures to watch when tuning idle polling on low power sites.
+void DreamFocuser::updateWakeupStats()
+{
+    struct rusage usage;
+    double now = TimerWheel::now(), cpu;
+
+    getrusage(RUSAGE_SELF, &usage);
+    cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+    if ( (statsStartTime > 0) && (now > statsStartTime) )
+    {
+        WakeupStatsN[0].value = wakeups * 1000. / (now - statsStartTime);
+        WakeupStatsN[1].value = (cpu - statsStartCPU) * 3600. * 1000. / (now - statsStartTime);
+        WakeupStatsNP.s = idleMode ? IPS_IDLE : IPS_OK;
+    }
+
+    wakeups = 0;
+    statsStartTime = now;
+    statsStartCPU = cpu;
+}
+
+// Idle means nothing moves and nobody waits for us. Automation in progress
+// has to keep the focuser out of idle.
+bool DreamFocuser::isIdle()
+{
+    return !moveInProgress && !isMoving && !groupMoveActive && !settling && !resumePending && (FocusAbsPosNP.s != IPS_BUSY) &&
+           (backlashState == BACKLASH_IDLE) && (refocusState == REFOCUS_IDLE);
+}
+
+void DreamFocuser::updateIdle()
+{
+    double now = TimerWheel::now();
+
+    if ( !isIdle() )
+    {
+        wakeUp();
+        return;
+    }
+
+    if ( idleMode || (TicklessS[TICKLESS_ENABLE].s != ISS_ON) || (now - lastActivity < TicklessN[TICKLESS_GRACE].value * 1000) )
+        return;
+
+    LOGF_DEBUG("Focuser idle, polling every %.f s.", TicklessN[TICKLESS_KEEPALIVE].value);
+    idleMode = true;
+    for (int i = 0; i < POLL_FIELDS; i++)
+        schedule(&pollTask[i].task, pollPeriod(i), pollPeriod(i));
+}
+
+// Back to normal polling, the fields are refreshed right away
+void DreamFocuser::wakeUp()
+{
+    lastActivity = TimerWheel::now();
+    if ( !idleMode || !isConnected() )
+        return;
+
+    LOG_DEBUG("Focuser active, normal polling.");
+    idleMode = false;
+    for (int i = 0; i < POLL_FIELDS; i++)
+        schedule(&pollTask[i].task, 0, pollPeriod(i));
+}
+
+/*
+  Hotplug. The directory of the serial port is watched for the port node
+  (or its by-id link) going away or coming back, so an idle driver notices
+  at once rather than on the next keep-alive.
+*/
+void DreamFocuser::startHotplug()
+{
+#ifdef __linux__
+    char directory[MAXINDINAME];
+
+    strncpy(directory, serialConnection->port(), MAXINDINAME - 1);
+    directory[MAXINDINAME - 1] = '\0';
+
+    hotplugFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ( hotplugFD < 0 )
+    {
+        LOGF_WARN("No hotplug events: %s.", strerror(errno));
+        return;
+    }
+
+    hotplugWatch = inotify_add_watch(hotplugFD, dirname(directory), IN_CREATE | IN_DELETE | IN_ATTRIB);
+    if ( hotplugWatch < 0 )
+    {
+        LOGF_WARN("No hotplug events for %s: %s.", serialConnection->port(), strerror(errno));
+        close(hotplugFD);
+        hotplugFD = -1;
+        return;
+    }
+
+    hotplugCallbackID = IEAddCallback(hotplugFD, hotplugHelper, this);
+#endif
+}
+
+void DreamFocuser::stopHotplug()
+{
+    if ( hotplugCallbackID != -1 )
+        IERmCallback(hotplugCallbackID);
+    if ( hotplugFD != -1 )
+        close(hotplugFD);
+    hotplugCallbackID = hotplugFD = hotplugWatch = -1;
+}
+
+void DreamFocuser::hotplugHelper(int fd, void *context)
+{
+    INDI_UNUSED(fd);
+    static_cast<DreamFocuser *>(context)->hotplugEvent();
+}
+
+void DreamFocuser::hotplugEvent()
+{
+#ifdef __linux__
+    char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char path[MAXINDINAME];
+    const char *port;
+    bool changed = false;
+    ssize_t length;
+
+    strncpy(path, serialConnection->port(), MAXINDINAME - 1);
+    path[MAXINDINAME - 1] = '\0';
+    port = basename(path);
+
+    while ( (length = read(hotplugFD, events, sizeof(events))) > 0 )
+    {
+        for (char *p = events; p < events + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if ( (event->len > 0) && !strcmp(event->name, port) )
+            {
+                if ( event->mask & IN_DELETE )
+                    LOGF_WARN("Port %s was removed.", serialConnection->port());
+                else if ( event->mask & IN_CREATE )
+                    LOGF_INFO("Port %s is back.", serialConnection->port());
+                changed = true;
+            }
+        }
+    }
+
+    // Poll right away, a vanished port shows up as link errors
+    if ( changed )
+        wakeUp();
+#endif
+}
+
+void DreamFocuser::errorSummaryHelper(void *context)
+{
+    static_cast<DreamFocuser *>(context)->summarizeLinkErrors();
+}
+
+void DreamFocuser::reopenHelper(void *context)
+{
+    static_cast<DreamFocuser *>(context)->reopenPort();
+}
+
+// A write fails when the port went away under the driver (a hub reset, a
+// pulled cable). Close it and open it again, which repeats the handshake;
+// the next failed write tries again.
+void DreamFocuser::reopenPort()
+{
+    LOGF_WARN("Reopening %s.", serialConnection->port());
+    if ( PortFD >= 0 )
+        serialConnection->Disconnect();
+    PortFD = -1;
+
+    if ( serialConnection->Connect() )
+    {
+        PortFD = serialConnection->getPortFD();
+        LOG_INFO("Port reopened.");
+        wakeUp();
+    }
+    else
+        PortFD = -1;
+}
+
+// The first link error of a kind is logged right away, repeats are only
+// counted and summarized periodically, so a flaky link does not flood the
+// log and the clients with identical lines.
+void DreamFocuser::reportLinkError(LinkError error, const char *format, ...)
+{
+    char message[DREAMFOCUSER_ERROR_BUFFER];
+    va_list ap;
+
+    LinkErrorsN[error].value++;
+    LinkErrorsNP.s = IPS_ALERT;
+
+    if ( !scheduler.isScheduled(&errorSummaryTask) )
+        schedule(&errorSummaryTask, DREAMFOCUSER_ERROR_SUMMARY);
+
+    if ( errorReported[error] )
+    {
+        suppressedErrors[error]++;
+        return;
+    }
+
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+
+    errorReported[error] = true;
+    LOGF_ERROR("%s", message);
+}
+
+void DreamFocuser::summarizeLinkErrors()
+{
+    bool repeated = false;
+
+    for (int i = 0; i < LINK_ERRORS; i++)
+    {
+        if ( suppressedErrors[i] > 0 )
+        {
+            LOGF_ERROR("%s error repeated %lu times in the last %d s.", LinkErrorsN[i].label, suppressedErrors[i], DREAMFOCUSER_ERROR_SUMMARY / 1000);
+            repeated = true;
+        }
+        else
+            errorReported[i] = false;
+        suppressedErrors[i] = 0;
+    }
+
+    // Errors that kept repeating stay muted for one more period
+    if ( repeated )
+        schedule(&errorSummaryTask, DREAMFOCUSER_ERROR_SUMMARY);
+    else
+        LinkErrorsNP.s = IPS_OK;
+    IDSetNumber(&LinkErrorsNP, nullptr);
+}
+
+void DreamFocuser::recordPosition(int32_t position)
+{
+    double now = wallclock();
+
+    // Extend a stationary run instead of storing every identical sample
+    if ( historyCount >= 2 )
+    {
+        PositionSample &last = positionHistory[(historyStart + historyCount - 1) % DREAMFOCUSER_HISTORY_SIZE];
+        PositionSample &previous = positionHistory[(historyStart + historyCount - 2) % DREAMFOCUSER_HISTORY_SIZE];
+        if ( (last.position == position) && (previous.position == position) )
+        {
+            last.time = now;
+            return;
+        }
+    }
+
+    if ( historyCount == DREAMFOCUSER_HISTORY_SIZE )
+    {
+        historyStart = (historyStart + 1) % DREAMFOCUSER_HISTORY_SIZE;
+        historyCount--;
+    }
+    positionHistory[(historyStart + historyCount) % DREAMFOCUSER_HISTORY_SIZE] = { now, position };
+    historyCount++;
+}
+
+// Binary search for the samples around time and interpolate between them.
+// Times after the last sample give the current position.
+bool DreamFocuser::positionAt(double time, double *position)
+{
+    int low = 0, high = historyCount - 1;
+
+    if ( (historyCount == 0) || (time < positionHistory[historyStart].time) )
+        return false;
+
+    const PositionSample &last = positionHistory[(historyStart + high) % DREAMFOCUSER_HISTORY_SIZE];
+    if ( time >= last.time )
+    {
+        *position = currentPosition;
+        return true;
+    }
+
+    // Find the last sample not after time
+    while ( high - low > 1 )
+    {
+        int middle = (low + high) / 2;
+        if ( positionHistory[(historyStart + middle) % DREAMFOCUSER_HISTORY_SIZE].time <= time )
+            low = middle;
+        else
+            high = middle;
+    }
+
+    const PositionSample &before = positionHistory[(historyStart + low) % DREAMFOCUSER_HISTORY_SIZE];
+    const PositionSample &after = positionHistory[(historyStart + high) % DREAMFOCUSER_HISTORY_SIZE];
+    if ( after.time <= before.time )
+        *position = before.position;
+    else
+        *position = before.position + (after.position - before.position) * (time - before.time) / (after.time - before.time);
+    return true;
+}
+
+void DreamFocuser::recordTemperature(float temperature)
+{
+    double now = wallclock();
+
+    if ( thermalCount > 0 )
+    {
+        const TemperatureSample &last = thermalHistory[(thermalStart + thermalCount - 1) % DREAMFOCUSER_THERMAL_SIZE];
+        if ( now - last.time < DREAMFOCUSER_THERMAL_SPACING )
+            return;
+    }
+
+    if ( thermalCount == DREAMFOCUSER_THERMAL_SIZE )
+    {
+        thermalStart = (thermalStart + 1) % DREAMFOCUSER_THERMAL_SIZE;
+        thermalCount--;
+    }
+    thermalHistory[(thermalStart + thermalCount) % DREAMFOCUSER_THERMAL_SIZE] = { now, temperature };
+    thermalCount++;
+
+    updateThermal();
+}
+
+// Least squares slope in C/h of the samples between from and to
+bool DreamFocuser::temperatureSlope(double from, double to, double *slope)
+{
+    double st = 0, sy = 0, stt = 0, sty = 0;
+    int n = 0;
+
+    for (int i = 0; i < thermalCount; i++)
+    {
+        const TemperatureSample &sample = thermalHistory[(thermalStart + i) % DREAMFOCUSER_THERMAL_SIZE];
+        if ( (sample.time < from) || (sample.time > to) )
+            continue;
+        double t = (sample.time - from) / 3600.;
+        st += t;
+        sy += sample.temperature;
+        stt += t * t;
+        sty += t * sample.temperature;
+        n++;
+    }
+
+    double d = n * stt - st * st;
+    if ( (n < 3) || (d <= 0) )
+        return false;
+    *slope = (n * sty - st * sy) / d;
+    return true;
+}
+
+/*
+  The optics cool roughly exponentially towards the ambient temperature, so
+  the slope decays exponentially too. The slopes of the older and newer half
+  of the window give the decay rate, and from that the time until the slope
+  falls below the threshold, counted from the midpoint of the newer half and
+  then moved to now.
+*/
+void DreamFocuser::updateThermal()
+{
+    double now = wallclock();
+    double window = ThermalN[THERMAL_WINDOW].value * 60;
+    double threshold = ThermalN[THERMAL_THRESHOLD].value;
+    double slope, older, newer;
+
+    if ( (thermalCount == 0) || (thermalHistory[thermalStart].time > now - window) || !temperatureSlope(now - window, now, &slope) )
+    {
+        ThermalStateNP.s = IPS_IDLE;
+        IDSetNumber(&ThermalStateNP, nullptr);
+        return;
+    }
+
+    ThermalStateN[THERMAL_SLOPE].value = slope;
+    if ( fabs(slope) <= threshold )
+    {
+        ThermalStateN[THERMAL_FORECAST].value = 0;
+        if ( ThermalStateNP.s != IPS_OK )
+            ThermalStateN[THERMAL_EQUILIBRIUM_AT].value = now;
+        ThermalStateNP.s = IPS_OK;
+    }
+    else
+    {
+        ThermalStateN[THERMAL_FORECAST].value = -1;
+        ThermalStateN[THERMAL_EQUILIBRIUM_AT].value = 0;
+        if ( temperatureSlope(now - window, now - window / 2, &older) && temperatureSlope(now - window / 2, now, &newer) &&
+                (older * newer > 0) && (fabs(newer) < fabs(older)) )
+        {
+            // The half-window slopes belong to their midpoints, carry the newer one forward to now
+            double rate = log(older / newer) / (window / 2 / 3600.);
+            double hours = log(fabs(newer) / threshold) / rate - window / 4 / 3600.;
+            if ( hours < 0 )
+                hours = 0;
+            ThermalStateN[THERMAL_FORECAST].value = hours * 60;
+            ThermalStateN[THERMAL_EQUILIBRIUM_AT].value = now + hours * 3600;
+        }
+        ThermalStateNP.s = IPS_BUSY;
+    }
+    IDSetNumber(&ThermalStateNP, nullptr);
+}
+
+void DreamFocuser::updateJournal()
+{
+    journal.close();
+    JournalSP.s = IPS_IDLE;
+
+    if ( JournalS[JOURNAL_ENABLE].s == ISS_ON )
+    {
+        if ( journal.open(JournalT[0].text) )
+        {
+            LOGF_INFO("Journal enabled, writing to %s.", JournalT[0].text);
+            JournalSP.s = IPS_OK;
+        }
+        else
+        {
+            LOGF_ERROR("Can not open journal %s: %s", JournalT[0].text, strerror(errno));
+            JournalSP.s = IPS_ALERT;
+        }
+    }
+    IDSetSwitch(&JournalSP, nullptr);
+}
+
+// Zigzag LEB128, small deltas of either sign take a byte or two
+static int pack_varint(unsigned char *out, int64_t value)
+{
+    uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    int n = 0;
+
+    while ( v >= 0x80 )
+    {
+        out[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+/*
+  One snapshot of everything the status properties carry. A full snapshot
+  holds every field, a delta only the fields that changed, each as the
+  difference to the last snapshot sent. Nothing is sent when only the time
+  moved on.
+*/
+void DreamFocuser::publishPackedStatus()
+{
+    int64_t fields[DREAMFOCUSER_PACKED_FIELDS];
+    bool key = packedSinceKey >= DREAMFOCUSER_KEYFRAME;
+    int mask = 0, n = 2;
+
+    packedDue = false;
+
+    fields[PACKED_TIME] = (int64_t)(wallclock() * 1000);
+    fields[PACKED_POSITION] = currentPosition;
+    fields[PACKED_TARGET] = finalPosition;
+    fields[PACKED_FLAGS] = (isMoving ? 1 : 0) | (isAbsolute ? 2 : 0) | ((isParked & 3) << 2) | (isVcc12V ? 16 : 0) |
+                           (moveInProgress ? 32 : 0) | (ReadyNP.s == IPS_OK ? 64 : 0) | (FocusAbsPosNP.s == IPS_ALERT ? 128 : 0);
+    fields[PACKED_TEMPERATURE] = lround(currentTemperature * 10);
+    fields[PACKED_HUMIDITY] = lround(currentHumidity * 10);
+    fields[PACKED_DEW_POINT] = lround(WeatherN[2].value * 10);
+
+    for (int i = 0; i < DREAMFOCUSER_PACKED_FIELDS; i++)
+        if ( key || (fields[i] != packedLast[i]) )
+            mask |= 1 << i;
+    if ( mask == (1 << PACKED_TIME) )
+        return;
+
+    for (int i = 0; i < DREAMFOCUSER_PACKED_FIELDS; i++)
+    {
+        if ( mask & (1 << i) )
+            n += pack_varint(packedStatus + n, key ? fields[i] : fields[i] - packedLast[i]);
+        packedLast[i] = fields[i];
+    }
+    packedStatus[0] = (key ? 0x80 : 0) | 1;
+    packedStatus[1] = mask;
+    packedSinceKey = key ? 0 : packedSinceKey + 1;
+    if ( key && scheduler.isScheduled(&packedKeyTask) )
+        schedule(&packedKeyTask, DREAMFOCUSER_KEYFRAME_PERIOD, DREAMFOCUSER_KEYFRAME_PERIOD);
+
+    PackedStatusB[0].blob = packedStatus;
+    PackedStatusB[0].bloblen = PackedStatusB[0].size = n;
+    PackedStatusBP.s = IPS_OK;
+    IDSetBLOB(&PackedStatusBP, nullptr);
+}
+
+// A full snapshot at least every few seconds, even when nothing changes, so
+// a client subscribing mid-stream does not wait for the next change
+void DreamFocuser::packedKeyHelper(void *context)
+{
+    DreamFocuser *focuser = static_cast<DreamFocuser *>(context);
+
+    focuser->packedSinceKey = DREAMFOCUSER_KEYFRAME;
+    focuser->queuePackedStatus();
+}
+
+// IDSetBLOB base64 encodes into a buffer it allocates, so inside a tick the
+// snapshot waits for the end of it, see TimerHit
+void DreamFocuser::queuePackedStatus()
+{
+    if ( inTick )
+        packedDue = true;
+    else
+        publishPackedStatus();
+}
+
+/*
+  Fault injection. The next responses (or writes, for a lost port) are
+  corrupted the way a glitchy hub would, then the polls are watched until
+  one completes cleanly. Recovery time runs from the first fault to that
+  poll; every poll with a failed request is lost, and so is every property
+  update it could not make.
+*/
+void DreamFocuser::startFault(int fault)
+{
+    faultClass = fault;
+    faultRemaining = FaultN[0].value;
+    faultStart = 0;
+    faultLostPolls = faultLostUpdates = 0;
+    FaultSP.s = IPS_BUSY;
+    LOGF_INFO("Injecting %d faults: %s.", faultRemaining, FaultS[fault].label);
+    wakeUp();
+}
+
+// True when the current write (sending) or read should fail
+bool DreamFocuser::injectFault(bool sending)
+{
+    if ( (faultClass < 0) || (faultRemaining == 0) || (sending != (faultClass == FAULT_PORT)) )
+        return false;
+
+    if ( faultStart == 0 )
+        faultStart = TimerWheel::now();
+    faultRemaining--;
+    return true;
+}
+
+/*
+  Read the next response through the injected fault. The real reply is read
+  and then mangled on its way in: dropped bytes shift every later frame until
+  the framing is recovered, a stalled reply is held back and handed to the
+  next read, after this one has waited out its timeout.
+*/
+int DreamFocuser::readFaulty(int timeout, int *nbytes_read)
+{
+    unsigned char *bytes = (unsigned char *)&currentResponse;
+    int size = sizeof(currentResponse), more = 0;
+    int err_code = readLink((char *)bytes, size, timeout, nbytes_read);
+
+    if ( err_code != TTY_OK )
+        return err_code;
+
+    switch (faultClass)
+    {
+        case FAULT_DROP:
+            // Two bytes from the middle are lost, the read takes what follows instead
+            memmove(bytes + 3, bytes + 5, size - 5);
+            err_code = readLink((char *)bytes + size - 2, 2, timeout, &more);
+            *nbytes_read = size - 2 + more;
+            break;
+        case FAULT_CHECKSUM:
+            currentResponse.z ^= 0x5a;
+            break;
+        case FAULT_UNKNOWN_COMMAND:
+        case FAULT_BAD_CHECKSUM:
+            currentResponse.k = faultClass == FAULT_UNKNOWN_COMMAND ? '!' : '?';
+            currentResponse.z = calculate_checksum(currentResponse);
+            break;
+        case FAULT_STALL:
+            // Held back as if still on the way, the next read gets it
+            memcpy(unreadBytes, bytes, size);
+            unreadCount = size;
+            *nbytes_read = 0;
+            usleep(timeout * 1000000);
+            err_code = TTY_TIME_OUT;
+            break;
+    }
+    return err_code;
+}
+
+void DreamFocuser::checkFaultRecovery()
+{
+    int failed = 0;
+
+    if ( faultStart == 0 )
+        return;
+
+    for (int i = 0; i < pollCount; i++)
+        if ( !pollRequests[i].ok )
+            failed++;
+
+    if ( (failed > 0) || (pollCount == 0) || (faultRemaining > 0) )
+    {
+        if ( failed > 0 )
+        {
+            faultLostPolls++;
+            faultLostUpdates += failed;
+        }
+        return;
+    }
+
+    double recovery = TimerWheel::now() - faultStart;
+    FaultResultsN[3 * faultClass + FAULT_RECOVERY].value = recovery;
+    FaultResultsN[3 * faultClass + FAULT_LOST_POLLS].value = faultLostPolls;
+    FaultResultsN[3 * faultClass + FAULT_LOST_UPDATES].value = faultLostUpdates;
+    FaultResultsNP.s = IPS_OK;
+    IDSetNumber(&FaultResultsNP, nullptr);
+    LOGF_INFO("Recovered from %s in %.f ms, %d polls and %d updates lost.", FaultS[faultClass].label, recovery, faultLostPolls, faultLostUpdates);
+
+    if ( faultSequence && (faultClass + 1 < FAULT_CLASSES) )
+        startFault(faultClass + 1);
+    else
+    {
+        faultClass = -1;
+        FaultSP.s = IPS_OK;
+    }
+    IDSetSwitch(&FaultSP, nullptr);
+}
+
+void DreamFocuser::updateWeatherSource()
+{
+    const char *device = WeatherSourceT[WEATHER_DEVICE].text;
+
+    // Readings of a previous source no longer count
+    setExternalWeather(false);
+    weatherResolved = device[0] == '\0';
+    if ( weatherResolved )
+        return;
+
+    if ( isConnected() )
+        schedule(&weatherStaleTask, WeatherCheckN[WEATHER_STALE].value * 1000);
+    IDSnoopDevice(device, "WEATHER_PARAMETERS");
+    LOGF_INFO("Taking temperature and humidity from %s when it publishes them.", device);
+}
+
+// A weather device usually sits in a better spot than the focuser's own
+// sensor, so its ambient readings drive the weather, the temperature
+// compensation and the dew point while it keeps publishing them.
+void DreamFocuser::snoopWeather(XMLEle *root)
+{
+    float temperature = NAN, humidity = NAN;
+
+    if ( !isConnected() )
+        return;
+
+    // Values of a vector in alert are not trusted, the weather driver lost its sensor
+    if ( !strcmp(findXMLAttValu(root, "state"), "Alert") )
+        return;
+
+    for (XMLEle *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+    {
+        const char *element = findXMLAttValu(ep, "name");
+        if ( !strcmp(element, WeatherSourceT[WEATHER_TEMPERATURE].text) )
+            temperature = atof(pcdataXMLEle(ep));
+        else if ( !strcmp(element, WeatherSourceT[WEATHER_HUMIDITY].text) )
+            humidity = atof(pcdataXMLEle(ep));
+    }
+
+    if ( isnan(temperature) )
+        return;
+
+    externalTemperature = temperature;
+    externalHumidity = humidity;
+    setExternalWeather(true);
+    weatherResolved = true;
+    schedule(&weatherStaleTask, WeatherCheckN[WEATHER_STALE].value * 1000);
+
+    currentTemperature = externalTemperature;
+    if ( !isnan(externalHumidity) )
+        currentHumidity = externalHumidity;
+    updateWeather();
+}
+
+void DreamFocuser::setExternalWeather(bool active)
+{
+    if ( active == externalWeather )
+        return;
+
+    externalWeather = active;
+    if ( active )
+        LOGF_INFO("Using weather from %s, focuser sensor checked every %.f s.", WeatherSourceT[WEATHER_DEVICE].text, WeatherCheckN[WEATHER_CHECK_PERIOD].value);
+    else
+    {
+        LOG_INFO("Using the focuser temperature sensor.");
+        scheduler.cancel(&weatherStaleTask);
+    }
+
+    if ( isConnected() )
+        schedule(&pollTask[POLL_TEMPERATURE].task, active ? pollPeriod(POLL_TEMPERATURE) : 0, pollPeriod(POLL_TEMPERATURE));
+}
+
+void DreamFocuser::weatherStaleHelper(void *context)
+{
+    static_cast<DreamFocuser *>(context)->loseExternalWeather();
+}
+
+void DreamFocuser::loseExternalWeather()
+{
+    LOGF_WARN("No weather from %s for %.f s.", WeatherSourceT[WEATHER_DEVICE].text, WeatherCheckN[WEATHER_STALE].value);
+    setExternalWeather(false);
+    weatherResolved = true;
+}
+
+// The focuser's own reading is always published; with an external source it
+// only cross-checks it and the ambient values are put back
+void DreamFocuser::checkSensor()
+{
+    bool disagreed = SensorNP.s == IPS_ALERT;
+
+    SensorN[SENSOR_TEMPERATURE].value = currentTemperature;
+    SensorN[SENSOR_HUMIDITY].value = currentHumidity;
+    SensorN[SENSOR_DIFFERENCE].value = 0;
+    SensorNP.s = IPS_OK;
+
+    if ( externalWeather )
+    {
+        SensorN[SENSOR_DIFFERENCE].value = currentTemperature - externalTemperature;
+        if ( fabs(SensorN[SENSOR_DIFFERENCE].value) > WeatherCheckN[WEATHER_TOLERANCE].value )
+        {
+            if ( !disagreed )
+                LOGF_WARN("Focuser sensor reads %.1f C, %.1f C off %s.", currentTemperature, SensorN[SENSOR_DIFFERENCE].value, WeatherSourceT[WEATHER_DEVICE].text);
+            SensorNP.s = IPS_ALERT;
+        }
+
+        currentTemperature = externalTemperature;
+        if ( !isnan(externalHumidity) )
+            currentHumidity = externalHumidity;
+    }
+
+    IDSetNumber(&SensorNP, nullptr);
+}
+
+void DreamFocuser::updateWeather()
+{
+    WeatherNP.s = ( (WeatherN[0].value != currentTemperature) || (WeatherN[1].value != currentHumidity)) ? IPS_BUSY : IPS_OK;
+    WeatherN[0].value = currentTemperature;
+    WeatherN[1].value = currentHumidity;
+    WeatherN[2].value = pow(currentHumidity / 100, 1.0 / 8) * (112 + 0.9 * currentTemperature) + 0.1 * currentTemperature - 112;
+    recordTemperature(currentTemperature);
+    IDSetNumber(&WeatherNP, nullptr);
+}
+
+void DreamFocuser::updateMetricSource()
+{
+    const char *camera = MetricSourceT[METRIC_CAMERA].text;
+    const char *blob = MetricSourceT[METRIC_BLOB].text;
+
+    strncpy(SnoopImageBP.name, blob, MAXINDINAME - 1);
+    strncpy(SnoopImageB[0].name, blob, MAXINDINAME - 1);
+    if ( camera[0] == '\0' )
+        return;
+
+    IDSnoopDevice(camera, blob);
+    IDSnoopBLOBs(camera, blob, B_ALSO);
+    LOGF_INFO("Measuring focus from %s images of %s.", blob, camera);
+}
+
+// Star detection and HFR right next to the motion control, so autofocus
+// does not need a client to download every frame and send a move back.
+bool DreamFocuser::measureImage(const IBLOB *image)
+{
+    double start = monotonic_ms();
+    int stars = 0;
+
+    if ( strcmp(image->format, ".fits") )
+    {
+        LOGF_DEBUG("Skipping image in %s format, only uncompressed FITS is measured.", image->format);
+        return false;
+    }
+
+    if ( !focusMetric.loadFITS(image->blob, image->bloblen) )
+    {
+        LOGF_WARN("Focus metric: %s", focusMetric.error());
+        return false;
+    }
+
+    metricHFR = focusMetric.measureHFR(&stars);
+
+    // The frame belongs to where the focuser was in the middle of the exposure,
+    // not where it is when the image arrives
+    double position = currentPosition;
+    metricTime = wallclock();
+    if ( focusMetric.exposureStart() > 0 )
+    {
+        metricTime = focusMetric.exposureStart() + focusMetric.exposureTime() / 2;
+        if ( !positionAt(metricTime, &position) )
+            LOGF_DEBUG("No position history at exposure %.3f, using the current position.", metricTime);
+    }
+    metricPosition = lround(position);
+
+    FocusMetricN[METRIC_HFR].value = metricHFR;
+    FocusMetricN[METRIC_STARS].value = stars;
+    FocusMetricN[METRIC_POSITION].value = metricPosition;
+    FocusMetricN[METRIC_DURATION].value = monotonic_ms() - start;
+
+    LOGF_DEBUG("Focus metric: HFR %.2f px from %d stars in %dx%d frame, %.1f ms.", metricHFR, stars, focusMetric.frameWidth(), focusMetric.frameHeight(), FocusMetricN[METRIC_DURATION].value);
+    if ( stars == 0 )
+        return false;
+
+    // Whether the exposure started once the focuser was at rest, after the last
+    // move ended and the settle time passed. A camera left idle during the move
+    // gives a good first frame. Frames without DATE-OBS can not be placed, the
+    // first of them to arrive at rest is dropped instead.
+    if ( moveInProgress || isMoving || settling || (restWall == 0) )
+        frameAtRest = false;
+    else if ( focusMetric.exposureStart() > 0 )
+        frameAtRest = focusMetric.exposureStart() >= restWall;
+    else
+    {
+        frameAtRest = restFrameSeen;
+        restFrameSeen = true;
+    }
+
+    journal.write(JOURNAL_FOCUS, metricTime, 0, 0, metricPosition, currentTemperature, metricHFR);
+    learnSettle();
+    advanceBacklashMeasurement(true);
+    updateDrift();
+    if ( FocusCurveS[CURVE_COLLECT].s == ISS_ON )
+        addCurveSample();
+    return true;
+}
+
+/*
+  Backlash measurement. The focuser approaches a reference point from below
+  and the focus metric is taken, then it approaches the same point from above
+  and keeps stepping inward until the metric matches the reference again.
+  The steps needed are the backlash. The reference has to be on the slope of
+  the focus curve (defocused a little) and the camera has to keep exposing.
+  The 'P' position echo is the motor step count, which backlash does not
+  change, so it can not be used for this.
+*/
+bool DreamFocuser::startBacklashMeasurement()
+{
+    if ( MetricSourceT[METRIC_CAMERA].text[0] == '\0' )
+    {
+        LOG_ERROR("Backlash measurement needs a camera set in the focus metric source.");
+        return false;
+    }
+    if ( isAbsolute == false || isParked != 0 || moveInProgress )
+    {
+        LOG_ERROR("Backlash measurement needs an unparked, synced and stopped focuser.");
+        return false;
+    }
+
+    LOGF_INFO("Measuring backlash around %d, keep the camera exposing.", currentPosition);
+    backlashReference = currentPosition;
+    backlashMove(backlashReference - BacklashMeasureN[BACKLASH_SPAN].value, BACKLASH_TO_LOW);
+    return backlashState != BACKLASH_IDLE;
+}
+
+void DreamFocuser::stopBacklashMeasurement(IPState state)
+{
+    backlashState = BACKLASH_IDLE;
+    BacklashMeasureSP.s = state;
+    IDSetSwitch(&BacklashMeasureSP, nullptr);
+}
+
+void DreamFocuser::backlashMove(int32_t position, BacklashState next)
+{
+    if ( startMove(position, false) )
+    {
+        backlashState = next;
+        FocusAbsPosNP.s = IPS_BUSY;
+        IDSetNumber(&FocusAbsPosNP, nullptr);
+    }
+    else
+    {
+        LOG_ERROR("Backlash measurement move failed.");
+        stopBacklashMeasurement(IPS_ALERT);
+    }
+}
+
+// Called when a move has arrived and when a new focus metric sample is in
+void DreamFocuser::advanceBacklashMeasurement(bool sampled)
+{
+    bool arrived = !moveInProgress && !isMoving;
+    double step = BacklashMeasureN[BACKLASH_STEP].value;
+
+    // A frame exposed during the move or the settling says nothing about the target
+    if ( !frameAtRest )
+        sampled = false;
+
+    switch (backlashState)
+    {
+        case BACKLASH_IDLE:
+            break;
+
+        case BACKLASH_TO_LOW:
+            if ( arrived )
+                backlashMove(backlashReference, BACKLASH_TO_REFERENCE_OUT);
+            break;
+
+        case BACKLASH_TO_REFERENCE_OUT:
+            if ( arrived )
+                backlashState = BACKLASH_SAMPLE_REFERENCE;
+            break;
+
+        case BACKLASH_SAMPLE_REFERENCE:
+            if ( sampled )
+            {
+                backlashReferenceHFR = metricHFR;
+                LOGF_DEBUG("Backlash reference HFR %.2f.", backlashReferenceHFR);
+                backlashMove(backlashReference + BacklashMeasureN[BACKLASH_SPAN].value, BACKLASH_TO_HIGH);
+            }
+            break;
+
+        case BACKLASH_TO_HIGH:
+            if ( arrived )
+            {
+                backlashSteps = 0;
+                backlashMove(backlashReference, BACKLASH_TO_REFERENCE_IN);
+            }
+            break;
+
+        case BACKLASH_TO_REFERENCE_IN:
+            if ( arrived )
+                backlashState = BACKLASH_SAMPLE_STEP;
+            break;
+
+        case BACKLASH_SAMPLE_STEP:
+            if ( sampled )
+            {
+                double difference = metricHFR - backlashReferenceHFR;
+                double previous = backlashPreviousHFR - backlashReferenceHFR;
+
+                LOGF_DEBUG("Backlash probe %d steps: HFR %.2f.", (int)(backlashSteps * step), metricHFR);
+
+                // The metric crossed the reference, interpolate between the last two probes
+                if ( (backlashSteps == 0 && fabs(difference) < 0.02 * backlashReferenceHFR) ||
+                        (backlashSteps > 0 && ((difference > 0) != (previous > 0))) )
+                {
+                    double backlash = 0;
+                    if ( backlashSteps > 0 )
+                        backlash = (backlashSteps - 1 + previous / (previous - difference)) * step;
+                    SetBacklashN[0].value = round(backlash);
+                    SetBacklashNP.s = IPS_OK;
+                    IDSetNumber(&SetBacklashNP, nullptr);
+                    LOGF_INFO("Measured backlash: %.f steps.", SetBacklashN[0].value);
+                    saveConfig(true, SetBacklashNP.name);
+                    stopBacklashMeasurement(IPS_OK);
+                    break;
+                }
+
+                if ( (backlashSteps + 1) * step > BacklashMeasureN[BACKLASH_MAX].value )
+                {
+                    LOG_ERROR("Backlash measurement failed, the metric did not return to the reference. Start from a defocused position.");
+                    stopBacklashMeasurement(IPS_ALERT);
+                    break;
+                }
+
+                backlashPreviousHFR = metricHFR;
+                backlashSteps++;
+                backlashMove(backlashReference - backlashSteps * step, BACKLASH_TO_REFERENCE_IN);
+            }
+            break;
+    }
+}
+
+void DreamFocuser::resetDrift()
+{
+    driftPosition = currentPosition;
+    driftFrames = 0;
+    driftSum = driftSumSquares = driftCusum = 0;
+
+    DriftStateN[DRIFT_CUSUM].value = 0;
+    DriftStateN[DRIFT_FRAMES].value = 0;
+    DriftStateNP.s = IPS_IDLE;
+    IDSetNumber(&DriftStateNP, nullptr);
+}
+
+/*
+  Called for every measured frame. Frames taken at a still focuser build a
+  baseline of the HFR, after that a one sided CUSUM sums how far the HFR
+  runs above it. Seeing makes the HFR scatter both ways and the allowance
+  absorbs that, defocus pushes it up frame after frame until the sum crosses
+  the threshold. Moving the focuser starts a new baseline.
+*/
+void DreamFocuser::updateDrift()
+{
+    if ( DriftS[DRIFT_OFF].s == ISS_ON )
+        return;
+
+    if ( refocusState != REFOCUS_IDLE )
+    {
+        advanceRefocus();
+        return;
+    }
+
+    if ( moveInProgress || settling || (backlashState != BACKLASH_IDLE) )
+        return;
+
+    if ( (driftPosition != currentPosition) || (metricPosition != currentPosition) )
+    {
+        resetDrift();
+        return;
+    }
+
+    if ( !frameAtRest )
+        return;
+
+    double baseline = DriftN[DRIFT_BASELINE].value;
+    DriftStateN[DRIFT_FRAMES].value = ++driftFrames;
+
+    if ( driftFrames <= baseline )
+    {
+        driftSum += metricHFR;
+        driftSumSquares += metricHFR * metricHFR;
+        DriftStateN[DRIFT_HFR].value = driftSum / driftFrames;
+        DriftStateN[DRIFT_SIGMA].value = sqrt(fmax(0, driftSumSquares / driftFrames - DriftStateN[DRIFT_HFR].value * DriftStateN[DRIFT_HFR].value));
+        if ( driftFrames == baseline )
+        {
+            LOGF_DEBUG("Drift baseline at %d: HFR %.2f +- %.3f.", driftPosition, DriftStateN[DRIFT_HFR].value, DriftStateN[DRIFT_SIGMA].value);
+            DriftStateNP.s = IPS_OK;
+        }
+        IDSetNumber(&DriftStateNP, nullptr);
+        return;
+    }
+
+    // A perfectly steady baseline would make any noise significant
+    double sigma = fmax(DriftStateN[DRIFT_SIGMA].value, 0.02 * DriftStateN[DRIFT_HFR].value);
+    driftCusum = fmax(0, driftCusum + (metricHFR - DriftStateN[DRIFT_HFR].value) / sigma - DriftN[DRIFT_ALLOWANCE].value);
+    DriftStateN[DRIFT_CUSUM].value = driftCusum;
+
+    if ( (driftCusum > DriftN[DRIFT_THRESHOLD].value) && (DriftStateNP.s == IPS_OK) )
+    {
+        LOGF_WARN("Focus drift: HFR %.2f against %.2f at %d.", metricHFR, DriftStateN[DRIFT_HFR].value, driftPosition);
+        DriftStateNP.s = IPS_ALERT;
+        if ( DriftS[DRIFT_REFOCUS].s == ISS_ON )
+        {
+            refocusCenter = currentPosition;
+            refocusCenterHFR = metricHFR;
+            refocusMove(refocusCenter - DriftN[DRIFT_STEP].value, REFOCUS_SAMPLE_LOW);
+            return;
+        }
+    }
+    IDSetNumber(&DriftStateNP, nullptr);
+}
+
+void DreamFocuser::refocusMove(int32_t position, RefocusState next)
+{
+    if ( startMove(position) )
+    {
+        refocusState = next;
+        DriftStateNP.s = IPS_BUSY;
+        FocusAbsPosNP.s = IPS_BUSY;
+        IDSetNumber(&FocusAbsPosNP, nullptr);
+    }
+    else
+    {
+        LOG_ERROR("Refocus move failed.");
+        refocusState = REFOCUS_IDLE;
+        DriftStateNP.s = IPS_ALERT;
+    }
+    IDSetNumber(&DriftStateNP, nullptr);
+}
+
+/*
+  Short refocus: the HFR is sampled one step either side of the drifted
+  position and the focuser moves to the vertex of the parabola through the
+  three points, at most two steps away. Moves keep the backlash compensated
+  final approach, so the samples are comparable.
+*/
+void DreamFocuser::advanceRefocus()
+{
+    double step = DriftN[DRIFT_STEP].value;
+
+    if ( moveInProgress || settling || !frameAtRest )
+        return;
+
+    switch (refocusState)
+    {
+        case REFOCUS_IDLE:
+            break;
+
+        case REFOCUS_SAMPLE_LOW:
+            refocusLowHFR = metricHFR;
+            refocusMove(refocusCenter + step, REFOCUS_SAMPLE_HIGH);
+            break;
+
+        case REFOCUS_SAMPLE_HIGH:
+        {
+            double low = refocusLowHFR, center = refocusCenterHFR, high = metricHFR;
+            double curvature = low - 2 * center + high;
+            double offset;
+
+            if ( curvature > 0 )
+                offset = fmax(-2, fmin(2, (low - high) / (2 * curvature))) * step;
+            else
+                offset = low < high ? -step : step;
+
+            LOGF_INFO("Refocus: HFR %.2f / %.2f / %.2f, moving to %d.", low, center, high, refocusCenter + (int32_t)round(offset));
+            refocusMove(refocusCenter + round(offset), REFOCUS_TO_BEST);
+            break;
+        }
+
+        case REFOCUS_TO_BEST:
+            refocusState = REFOCUS_IDLE;
+            resetDrift();
+            break;
+    }
+}
+
+// Every still frame of a sweep refits the curve, the fit takes milliseconds
+// so the result is out before the next move of the sweep
+void DreamFocuser::addCurveSample()
+{
+    if ( !frameAtRest || (metricPosition != currentPosition) )
+        return;
+
+    if ( !focusCurve.add(metricPosition, metricHFR) )
+    {
+        LOG_WARN("Focus curve is full, clear it to start a new sweep.");
+        return;
+    }
+    FocusCurveResultN[CURVE_SAMPLES].value = focusCurve.samples();
+
+    double start = monotonic_ms();
+    if ( focusCurve.fit(FocusCurveN[0].value) )
+    {
+        const FocusCurve::Result &result = focusCurve.result();
+        FocusCurveResultN[CURVE_POSITION].value = result.position;
+        FocusCurveResultN[CURVE_LOW].value = result.low;
+        FocusCurveResultN[CURVE_HIGH].value = result.high;
+        FocusCurveResultN[CURVE_HFR].value = result.hfr;
+        FocusCurveResultN[CURVE_MODEL].value = focusCurve.bestModel();
+        FocusCurveResultN[CURVE_INLIERS].value = result.inliers;
+        FocusCurveResultNP.s = IPS_OK;
+        LOGF_DEBUG("Focus curve: %s, best focus %.1f (%.1f - %.1f), HFR %.2f, %d of %d samples.", FocusCurve::modelName(focusCurve.bestModel()),
+                   result.position, result.low, result.high, result.hfr, result.inliers, focusCurve.samples());
+    }
+    else
+        FocusCurveResultNP.s = IPS_BUSY;
+    FocusCurveResultN[CURVE_DURATION].value = monotonic_ms() - start;
+    IDSetNumber(&FocusCurveResultNP, nullptr);
+}
+
+// Any motion, commanded or observed, drops READY until the focuser settles again
+void DreamFocuser::startSettle()
+{
+    settleSamples = 0;
+    settleStopTime = 0;
+    restWall = 0;
+    if ( settling )
+        return;
+
+    settling = true;
+    ReadyNP.s = IPS_BUSY;
+    IDSetNumber(&ReadyNP, nullptr);
+}
+
+void DreamFocuser::settleHelper(void *context)
+{
+    DreamFocuser *focuser = static_cast<DreamFocuser *>(context);
+
+    focuser->requestPoll((1 << POLL_STATUS) | (1 << POLL_POSITION));
+}
+
+/*
+  Called with fresh status and position. Once the motor reports stopped the
+  position is sampled fast, it has to hold still for SAMPLES samples and for
+  the settle time after its last change. In learned mode the settle time
+  comes from the focus metric, see learnSettle(); until it has been learned
+  the fixed time is used.
+*/
+void DreamFocuser::checkSettle()
+{
+    double now = TimerWheel::now();
+
+    if ( moveInProgress || isMoving )
+    {
+        startSettle();
+        return;
+    }
+
+    if ( !settling )
     {
-        LOG_ERROR("Focuser is not in Absolute mode. Please sync.");
-        return IPS_ALERT;
+        // Motion nobody commanded, e.g. the hand controller. Right after
+        // connecting the focuser has to settle once before the first READY.
+        if ( (ReadyNP.s != IPS_IDLE) && (currentPosition == ReadyN[READY_POSITION].value) )
+            return;
+        startSettle();
     }
 
-    if (isParked != 0)
+    if ( settleStopTime == 0 )
     {
-        LOG_ERROR("Please unpark before issuing any motion commands.");
-        return IPS_ALERT;
+        settleStopTime = settleLastChange = now;
+        settlePosition = currentPosition;
+        settleStopWall = wallclock();
+        settleFrames = 0;
     }
-    if ( setPosition(ticks) )
+    else if ( currentPosition != settlePosition )
     {
-        FocusAbsPosNP.s = IPS_OK;
-        IDSetNumber(&FocusAbsPosNP, nullptr);
-        return IPS_OK;
+        settleSamples = 0;
+        settleLastChange = now;
+        settlePosition = currentPosition;
     }
-    return IPS_ALERT;
+    else
+        settleSamples++;
+
+    double settleTime = (SettleS[SETTLE_LEARNED].s == ISS_ON) && (learnedSettle >= 0) ? learnedSettle : SettleN[SETTLE_TIME].value;
+    if ( (settleSamples < SettleN[SETTLE_SAMPLES].value) || (now - settleLastChange < settleTime) )
+    {
+        schedule(&settleTask, SettleN[SETTLE_PERIOD].value);
+        return;
+    }
+
+    settling = false;
+    restWall = wallclock() - (now - settleLastChange - settleTime) / 1000;
+    restFrameSeen = false;
+    ReadyN[READY_TIME].value = wallclock();
+    ReadyN[READY_POSITION].value = currentPosition;
+    ReadyN[READY_SETTLE].value = now - settleStopTime;
+    ReadyNP.s = IPS_OK;
+    IDSetNumber(&ReadyNP, nullptr);
+    LOGF_DEBUG("Ready at %d, settled %.f ms after the stop.", currentPosition, ReadyN[READY_SETTLE].value);
 }
 
-IPState DreamFocuser::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+/*
+  The step echo stops changing the moment the motor stops, the mechanics
+  settle after that, so the settle time is learned from the images. Frames
+  whose exposure started after a stop are compared with the last of them:
+  a blurred frame started before the focuser had settled, a sharp one
+  after. The settle time is raised above the latest blurred start and
+  brought down towards the first sharp start. Frames without DATE-OBS
+  can not be placed in time and are not used.
+*/
+void DreamFocuser::learnSettle()
 {
-    int32_t finalTicks = currentPosition + ((int32_t)ticks * (dir == FOCUS_INWARD ? -1 : 1));
+    double start = focusMetric.exposureStart();
 
-    LOGF_DEBUG("MoveRelPosition: %d", finalTicks);
+    if ( (settleStopWall == 0) || (start < settleStopWall) || (metricPosition != settlePosition) )
+        return;
 
-    if (isParked != 0)
+    settleFrameStart[settleFrames] = (start - settleStopWall) * 1000;
+    settleFrameHFR[settleFrames] = metricHFR;
+    if ( ++settleFrames < DREAMFOCUSER_SETTLE_FRAMES )
+        return;
+    settleStopWall = 0;
+
+    double sharp = settleFrameHFR[settleFrames - 1];
+    double low = 0, high = settleFrameStart[settleFrames - 1];
+    for (int i = settleFrames - 2; i >= 0; i--)
     {
-        LOG_ERROR("Please unpark before issuing any motion commands.");
-        return IPS_ALERT;
+        if ( settleFrameHFR[i] > (1 + DREAMFOCUSER_SETTLE_BLUR) * sharp )
+        {
+            low = settleFrameStart[i];
+            break;
+        }
+        high = settleFrameStart[i];
     }
 
-    if ( setPosition(finalTicks) )
+    double settle = learnedSettle >= 0 ? learnedSettle : SettleN[SETTLE_TIME].value;
+    if ( settle <= low )
+        settle = (low + high) / 2;
+    else if ( settle > high )
+        settle = 0.7 * settle + 0.3 * high;
+    learnedSettle = settle;
+    LOGF_DEBUG("Settle time %.f ms, blurred frames up to %.f ms and sharp from %.f ms after the stop.", learnedSettle, low, high);
+}
+
+void DreamFocuser::pollSliceHelper(void *context)
+{
+    DreamFocuser *focuser = static_cast<DreamFocuser *>(context);
+
+    if ( focuser->isConnected() && (focuser->pollNext < focuser->pollCount) )
+        focuser->runPollSlice();
+}
+
+// Fields that fall due while a poll cycle is running are picked up by the next one
+void DreamFocuser::requestPoll(int fields)
+{
+    pollDue |= fields;
+    if ( pollCount == 0 )
+        startPoll();
+}
+
+void DreamFocuser::startPoll()
+{
+    pollFields = pollDue;
+    pollDue = 0;
+
+    // Position is only followed once the focuser has been moved, or until the first READY
+    if ( (FocusAbsPosNP.s == IPS_IDLE) && (ReadyNP.s == IPS_OK) )
+        pollFields &= ~(1 << POLL_POSITION);
+
+    pollCount = pollNext = 0;
+    if ( pollFields & (1 << POLL_MAXPOS) )
+        addPollRequest('A', 3);
+    if ( pollFields & (1 << POLL_STATUS) )
     {
-        FocusRelPosNP.s = IPS_OK;
-        IDSetNumber(&FocusRelPosNP, nullptr);
-        return IPS_OK;
+        addPollRequest('I');
+        addPollRequest('W');
     }
-    return IPS_ALERT;
+    if ( pollFields & (1 << POLL_TEMPERATURE) )
+        addPollRequest('T');
+    if ( pollFields & (1 << POLL_POSITION) )
+        addPollRequest('P');
+
+    if ( pollCount == 0 )
+        return;
+
+    pollOldAbsStatus = FocusAbsPosNP.s;
+    pollOldPosition = currentPosition;
+    pollMoveGeneration = moveGeneration;
+    runPollSlice();
 }
 
+void DreamFocuser::addPollRequest(char k, unsigned char addr)
+{
+    pollRequests[pollCount].k = k;
+    pollRequests[pollCount].l = 0;
+    pollRequests[pollCount].addr = addr;
+    pollRequests[pollCount].ok = false;
+    pollCount++;
+}
 
-void DreamFocuser::TimerHit()
+DreamFocuser::DreamFocuserRequest *DreamFocuser::polled(char k)
 {
+    for (int i = 0; i < pollCount; i++)
+        if ( pollRequests[i].k == k )
+            return &pollRequests[i];
+    return nullptr;
+}
 
-    if ( ! isConnected() )
-        return;
+// Run one slice of background polling. Between slices control returns to the
+// event loop, so a client move, abort, park or sync waits at most one slice.
+void DreamFocuser::runPollSlice()
+{
+    int n = pollCount - pollNext;
+
+    if ( n > pipelineDepth )
+        n = pipelineDepth;
 
-    int oldAbsStatus = FocusAbsPosNP.s;
-    int32_t oldPosition = currentPosition;
+    dispatch_batch(&pollRequests[pollNext], n, pipelineDepth);
+    pollNext += n;
+    interactiveStreak = 0;
 
-    if ( getMaxPosition() )
+    if ( pollNext < pollCount )
     {
-        if ( FocusMaxPosN[0].value != currentMaxPosition ) {
-            FocusMaxPosN[0].value = currentMaxPosition;
-            FocusMaxPosNP.s = IPS_OK;
-            IDSetNumber(&FocusMaxPosNP, nullptr);
-            SetFocuserMaxPosition(currentMaxPosition);
-        }
+        if ( !scheduler.isScheduled(&pollSliceTask) )
+            schedule(&pollSliceTask, 0);
+        return;
     }
-    else
-        FocusMaxPosNP.s = IPS_ALERT;
 
-    if ( getStatus() )
+    finishPoll();
+}
+
+// Commands a client is waiting for go out ahead of pending background
+// polling. After a run of them one background slice is let through first.
+// Commands sent for a client, these also bring polling back from idle
+bool DreamFocuser::dispatch_interactive(char k, uint32_t l, unsigned char addr)
+{
+    wakeUp();
+    if ( (interactiveStreak >= DREAMFOCUSER_STARVATION) && (pollNext < pollCount) )
     {
+        LOG_DEBUG("Letting background polling through.");
+        runPollSlice();
+    }
+    interactiveStreak++;
+
+    return dispatch_command(k, l, addr);
+}
+
+void DreamFocuser::finishPoll()
+{
+    DreamFocuserRequest *maxPosition = polled('A');
+    DreamFocuserRequest *status = polled('I');
+    DreamFocuserRequest *absolute = polled('W');
+    DreamFocuserRequest *temperature = polled('T');
+    DreamFocuserRequest *position = polled('P');
+    int oldAbsStatus = pollOldAbsStatus;
+    int32_t oldPosition = pollOldPosition;
+
+    scheduler.cancel(&pollSliceTask);
 
-        StatusSP.s = IPS_OK;
-        if ( isMoving )
+    if ( maxPosition )
+    {
+        if ( maxPosition->ok )
         {
-            //LOG_INFO("Moving" );
-            FocusAbsPosNP.s = IPS_BUSY;
-            StatusS[1].s = ISS_ON;
+            decodeMaxPosition(maxPosition->response);
+            if ( FocusMaxPosN[0].value != currentMaxPosition ) {
+                FocusMaxPosN[0].value = currentMaxPosition;
+                FocusMaxPosNP.s = IPS_OK;
+                IDSetNumber(&FocusMaxPosNP, nullptr);
+                SetFocuserMaxPosition(currentMaxPosition);
+            }
         }
         else
-        {
-            if ( FocusAbsPosNP.s != IPS_IDLE )
-                FocusAbsPosNP.s = IPS_OK;
-            StatusS[1].s = ISS_OFF;
-        };
+            FocusMaxPosNP.s = IPS_ALERT;
+    }
 
-        if ( isParked == 1 )
-        {
-            ParkSP.s = IPS_BUSY;
-            StatusS[2].s = ISS_ON;
-            ParkS[0].s = ISS_ON;
-        }
-        else if ( isParked == 2 )
+    if ( status && absolute )
+    {
+        if ( status->ok && absolute->ok )
         {
-            ParkSP.s = IPS_OK;
-            StatusS[2].s = ISS_ON;
-            ParkS[0].s = ISS_ON;
+            decodeStatus(status->response);
+            decodeAbsolute(absolute->response);
+
+            StatusSP.s = IPS_OK;
+            if ( isMoving )
+            {
+                //LOG_INFO("Moving" );
+                FocusAbsPosNP.s = IPS_BUSY;
+                StatusS[1].s = ISS_ON;
+            }
+            else
+            {
+                if ( FocusAbsPosNP.s != IPS_IDLE )
+                    FocusAbsPosNP.s = IPS_OK;
+                StatusS[1].s = ISS_OFF;
+            };
+
+            if ( isParked == 1 )
+            {
+                ParkSP.s = IPS_BUSY;
+                StatusS[2].s = ISS_ON;
+                ParkS[0].s = ISS_ON;
+            }
+            else if ( isParked == 2 )
+            {
+                ParkSP.s = IPS_OK;
+                StatusS[2].s = ISS_ON;
+                ParkS[0].s = ISS_ON;
+            }
+            else
+            {
+                StatusS[2].s = ISS_OFF;
+                ParkS[1].s = ISS_ON;
+                ParkSP.s = IPS_IDLE;
+            }
+
+            if ( isAbsolute )
+            {
+                StatusS[0].s = ISS_ON;
+                if ( FocusAbsPosN[0].min != 0 )
+                {
+                    FocusAbsPosN[0].min = 0;
+                    IDSetNumber(&FocusAbsPosNP, nullptr);
+                }
+            }
+            else
+            {
+                if ( FocusAbsPosN[0].min == 0 )
+                {
+                    FocusAbsPosN[0].min = -FocusAbsPosN[0].max;
+                    IDSetNumber(&FocusAbsPosNP, nullptr);
+                }
+                StatusS[0].s = ISS_OFF;
+            }
+
+            StatusS[STATUS_VCC12V].s = isVcc12V ? ISS_ON : ISS_OFF;
+
+            // A move started elsewhere (e.g. the hand controller) is followed from now on
+            if ( isMoving && !position )
+                pollDue |= 1 << POLL_POSITION;
         }
         else
+            StatusSP.s = IPS_ALERT;
+
+        IDSetSwitch(&StatusSP, nullptr);
+        IDSetSwitch(&ParkSP, nullptr);
+    }
+
+    if ( temperature )
+    {
+        if ( temperature->ok )
         {
-            StatusS[2].s = ISS_OFF;
-            ParkS[1].s = ISS_ON;
-            ParkSP.s = IPS_IDLE;
+            decodeTemperature(temperature->response);
+            checkSensor();
+            updateWeather();
         }
-
-        if ( isAbsolute )
+        else if ( externalWeather )
         {
-            StatusS[0].s = ISS_ON;
-            if ( FocusAbsPosN[0].min != 0 )
-            {
-                FocusAbsPosN[0].min = 0;
-                IDSetNumber(&FocusAbsPosNP, nullptr);
-            }
+            SensorNP.s = IPS_ALERT;
+            IDSetNumber(&SensorNP, nullptr);
         }
         else
         {
-            if ( FocusAbsPosN[0].min == 0 )
-            {
-                FocusAbsPosN[0].min = -FocusAbsPosN[0].max;
-                IDSetNumber(&FocusAbsPosNP, nullptr);
-            }
-            StatusS[0].s = ISS_OFF;
+            WeatherNP.s = IPS_ALERT;
+            IDSetNumber(&WeatherNP, nullptr);
         }
-
     }
-    else
-        StatusSP.s = IPS_ALERT;
 
-    if ( getTemperature() )
+    if ( position && position->ok )
     {
-        WeatherNP.s = ( (WeatherN[0].value != currentTemperature) || (WeatherN[1].value != currentHumidity)) ? IPS_BUSY : IPS_OK;
-        WeatherN[0].value = currentTemperature;
-        WeatherN[1].value = currentHumidity;
-        WeatherN[2].value = pow(currentHumidity / 100, 1.0 / 8) * (112 + 0.9 * currentTemperature) + 0.1 * currentTemperature - 112;
+        decodePosition(position->response);
+        recordPosition(currentPosition);
     }
-    else
-        WeatherNP.s = IPS_ALERT;
 
-    if ( FocusAbsPosNP.s != IPS_IDLE )
+    if ( position && ( FocusAbsPosNP.s != IPS_IDLE ) )
     {
-        if ( getPosition() )
+        if ( position->ok )
         {
             if ( oldPosition != currentPosition )
             {
@@ -658,16 +3678,34 @@ void DreamFocuser::TimerHit()
             FocusAbsPosNP.s = IPS_ALERT;
     }
 
+    // Motion checks need fresh status and position. A move sent between
+    // slices makes this poll's motion state stale.
+    if ( status && status->ok && position && position->ok && (pollMoveGeneration == moveGeneration) )
+    {
+        checkMove();
+        checkGroupMove();
+        checkResume();
+        checkSettle();
+    }
+
 
     if ((oldAbsStatus != FocusAbsPosNP.s) || (oldPosition != currentPosition))
         IDSetNumber(&FocusAbsPosNP, nullptr);
 
-    IDSetNumber(&WeatherNP, nullptr);
-    //IDSetSwitch(&SyncSP, nullptr);
-    IDSetSwitch(&StatusSP, nullptr);
-   IDSetSwitch(&ParkSP, NULL);
+    if ( status && status->ok )
+        updateIdle();
 
-    SetTimer(POLLMS);
+    if ( PackedStatusS[PACKED_ENABLE].s == ISS_ON )
+        queuePackedStatus();
+
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+    if ( faultClass >= 0 )
+        checkFaultRecovery();
+#endif
+
+    pollCount = pollNext = 0;
+    if ( pollDue )
+        startPoll();
 
 }
 
@@ -742,23 +3780,36 @@ bool DreamFocuser::send_command(char k, uint32_t l, unsigned char addr)
     c.addr = addr;
     c.z = calculate_checksum(c);
 
-    LOGF_DEBUG("Sending command: c=%c, a=%hhu, b=%hhu, c=%hhu, d=%hhu ($%hhx), n=%hhu, z=%hhu", c.k, c.a, c.b, c.c, c.d, c.d, c.addr, c.z);
+    if ( isDebug() )
+        LOGF_DEBUG("Sending command: c=%c, a=%hhu, b=%hhu, c=%hhu, d=%hhu ($%hhx), n=%hhu, z=%hhu", c.k, c.a, c.b, c.c, c.d, c.d, c.addr, c.z);
 
-    tcflush(PortFD, TCIOFLUSH);
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+    // The port vanishes under the driver, the write below fails on it
+    if ( injectFault(true) )
+    {
+        serialConnection->Disconnect();
+        PortFD = -1;
+    }
+#endif
 
     if ( (err_code = tty_write(PortFD, (char *)&c, sizeof(c), &nbytes_written) != TTY_OK))
     {
         tty_error_msg(err_code, dreamFocuser_error, DREAMFOCUSER_ERROR_BUFFER);
-        LOGF_ERROR("TTY error detected: %s", dreamFocuser_error);
+        reportLinkError(LINK_ERROR_WRITE, "TTY error detected: %s", dreamFocuser_error);
+        // Reopen outside of any exchange, a batch may still be unwinding
+        if ( isConnected() && !scheduler.isScheduled(&reopenTask) )
+            schedule(&reopenTask, DREAMFOCUSER_REOPEN_DELAY);
         return false;
     }
 
-    LOGF_DEBUG("Sending complete. Number of bytes written: %d", nbytes_written);
+    if ( isDebug() )
+        LOGF_DEBUG("Sending complete. Number of bytes written: %d", nbytes_written);
+    pushPending(k);
 
     return true;
 }
 
-bool DreamFocuser::read_response()
+bool DreamFocuser::read_response(int timeout)
 {
     int err_code = 0, nbytes_read = 0, z;
     char err_msg[DREAMFOCUSER_ERROR_BUFFER];
@@ -766,50 +3817,98 @@ bool DreamFocuser::read_response()
     //LOG_DEBUG("Read response");
 
     // Read a single response
-    if ( (err_code = tty_read(PortFD, (char *)&currentResponse, sizeof(currentResponse), 5, &nbytes_read)) != TTY_OK)
+#ifdef DREAMFOCUSER_FAULT_INJECTION
+    if ( injectFault(false) )
+        err_code = readFaulty(timeout, &nbytes_read);
+    else
+#endif
+        err_code = readLink((char *)&currentResponse, sizeof(currentResponse), timeout, &nbytes_read);
+    if ( err_code != TTY_OK )
     {
+        responseStatus = RESPONSE_TIMEOUT;
         tty_error_msg(err_code, err_msg, 32);
-        LOGF_ERROR("TTY error detected: %s", err_msg);
+        reportLinkError(LINK_ERROR_TIMEOUT, "TTY error detected: %s", err_msg);
+        abandonPending();
         return false;
     }
-    LOGF_DEBUG("Response: %c, a=%hhu, b=%hhu, c=%hhu, d=%hhu ($%hhx), n=%hhu, z=%hhu", currentResponse.k, currentResponse.a, currentResponse.b, currentResponse.c, currentResponse.d, currentResponse.d, currentResponse.addr, currentResponse.z);
+    if ( isDebug() )
+        LOGF_DEBUG("Response: %c, a=%hhu, b=%hhu, c=%hhu, d=%hhu ($%hhx), n=%hhu, z=%hhu", currentResponse.k, currentResponse.a, currentResponse.b, currentResponse.c, currentResponse.d, currentResponse.d, currentResponse.addr, currentResponse.z);
 
     if ( nbytes_read != sizeof(currentResponse) )
     {
-        LOGF_ERROR("Number of bytes read: %d, expected: %d", nbytes_read, sizeof(currentResponse));
+        responseStatus = RESPONSE_SHORT;
+        reportLinkError(LINK_ERROR_SHORT, "Number of bytes read: %d, expected: %d", nbytes_read, (int)sizeof(currentResponse));
+        // The torn frame was the oldest reply, the ones behind it may still come
+        popPending();
+        abandonPending();
         return false;
     }
 
+    // A whole frame answers the oldest request, whatever it holds
+    popPending();
+
     z = calculate_checksum(currentResponse);
     if ( z != currentResponse.z )
     {
-        LOGF_ERROR("Response checksum in not correct %hhu, expected: %hhu", currentResponse.z, z );
+        responseStatus = RESPONSE_CHECKSUM;
+        reportLinkError(LINK_ERROR_CHECKSUM, "Response checksum in not correct %hhu, expected: %hhu", currentResponse.z, z );
         return false;
     }
 
     if ( currentResponse.k == '!' )
     {
-        LOG_ERROR("Focuser reported unrecognized command.");
+        responseStatus = RESPONSE_UNKNOWN_COMMAND;
+        reportLinkError(LINK_ERROR_UNKNOWN_COMMAND, "Focuser reported unrecognized command.");
         return false;
     }
 
     if ( currentResponse.k == '?' )
     {
-        LOG_ERROR("Focuser reported bad checksum.");
+        responseStatus = RESPONSE_BAD_CHECKSUM;
+        reportLinkError(LINK_ERROR_BAD_CHECKSUM, "Focuser reported bad checksum.");
         return false;
     }
 
+    responseStatus = RESPONSE_OK;
     return true;
 }
 
+// Every read of the link comes through here, after any bytes put back earlier
+int DreamFocuser::readLink(char *buffer, int size, int timeout, int *nbytes_read)
+{
+    int held = 0, err_code = TTY_OK;
+
+    if ( unreadCount > 0 )
+    {
+        held = unreadCount < size ? unreadCount : size;
+        memcpy(buffer, unreadBytes, held);
+        unreadCount -= held;
+        memmove(unreadBytes, unreadBytes + held, unreadCount);
+    }
+
+    *nbytes_read = 0;
+    if ( held < size )
+        err_code = tty_read(PortFD, buffer + held, size - held, timeout, nbytes_read);
+    *nbytes_read += held;
+    return err_code;
+}
+
 bool DreamFocuser::dispatch_command(char k, uint32_t l, unsigned char addr)
 {
-    LOG_DEBUG("send_command");
+    double start = monotonic_ms();
+
+    if ( isDebug() )
+        LOG_DEBUG("send_command");
+    flushLink();
     if ( send_command(k, l, addr) )
     {
-        if ( read_response() )
+        bool ok = read_response();
+        if ( journal.isOpen() )
+            journal.write(JOURNAL_COMMAND, wallclock(), k, responseStatus, 0, monotonic_ms() - start);
+        if ( ok )
         {
-            LOG_DEBUG("check currentResponse.k");
+            if ( isDebug() )
+                LOG_DEBUG("check currentResponse.k");
             if ( currentResponse.k == k )
                 return true;
         }
@@ -817,6 +3916,289 @@ bool DreamFocuser::dispatch_command(char k, uint32_t l, unsigned char addr)
     return false;
 }
 
+void DreamFocuser::pushPending(char k)
+{
+    // The table only overflows if reads were skipped, the oldest entry is the least likely to answer
+    if ( pendingCount == DREAMFOCUSER_MAX_PENDING )
+        popPending();
+
+    PendingRequest &request = pending[(pendingHead + pendingCount) % DREAMFOCUSER_MAX_PENDING];
+    request.k = k;
+    request.abandoned = false;
+    request.expires = 0;
+    pendingCount++;
+}
+
+void DreamFocuser::popPending()
+{
+    if ( pendingCount == 0 )
+        return;
+    pendingHead = (pendingHead + 1) % DREAMFOCUSER_MAX_PENDING;
+    pendingCount--;
+}
+
+// Nobody waits for these answers any more, but the focuser may still send them
+void DreamFocuser::abandonPending()
+{
+    double expires = monotonic_ms() + DREAMFOCUSER_LATE_WINDOW;
+
+    for (int i = 0; i < pendingCount; i++)
+    {
+        PendingRequest &request = pending[(pendingHead + i) % DREAMFOCUSER_MAX_PENDING];
+        if ( !request.abandoned )
+        {
+            request.abandoned = true;
+            request.expires = expires;
+        }
+    }
+}
+
+/*
+  The focuser answers in order and its frames carry no tag, so a late reply
+  to a timed out 'P' looks exactly like the answer to the next 'P'. Requests
+  that timed out stay in the table until their late window closes; a frame
+  for one of them that is already waiting is dropped before anything new is
+  sent. If some are still unanswered, a query none of them used is sent as
+  a marker, and everything read before its answer is stale. A reply that
+  was lost rather than late then costs one round trip, not a timeout.
+*/
+
+void DreamFocuser::resyncLink()
+{
+    static const char markers[] = { 'V', 'W', 'I' };
+    DreamFocuserCommand frame;
+    char marker = 0;
+    int frames, nbytes_read = 0;
+
+    for (unsigned int m = 0; (m < sizeof(markers)) && (marker == 0); m++)
+    {
+        marker = markers[m];
+        for (int i = 0; i < pendingCount; i++)
+            if ( pending[(pendingHead + i) % DREAMFOCUSER_MAX_PENDING].k == marker )
+                marker = 0;
+    }
+
+    if ( (marker == 0) || !send_command(marker) )
+    {
+        pendingCount = 0;
+        return;
+    }
+
+    // At most one frame per abandoned request comes ahead of the marker's
+    frames = pendingCount;
+    pendingCount = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        if ( (readLink((char *)&frame, sizeof(frame), DREAMFOCUSER_RESYNC_TIMEOUT, &nbytes_read) != TTY_OK) ||
+                (nbytes_read != sizeof(frame)) )
+        {
+            reportLinkError(LINK_ERROR_TIMEOUT, "No answer to the '%c' resync query.", marker);
+            return;
+        }
+        if ( (frame.k == marker) && (calculate_checksum(frame) == frame.z) )
+            return;
+        reportLinkError(LINK_ERROR_STALE, "Dropped a late '%c' reply to an abandoned request.", frame.k);
+    }
+}
+
+// Bytes that can be read right away
+int DreamFocuser::linkAvailable()
+{
+    int waiting = 0;
+
+    if ( (PortFD < 0) || (ioctl(PortFD, FIONREAD, &waiting) < 0) )
+        waiting = 0;
+    return unreadCount + waiting;
+}
+
+// Take one frame from what has already arrived, without waiting. After a torn
+// frame the bytes up to the next 'M' header with a good checksum are skipped.
+bool DreamFocuser::readWaitingFrame(DreamFocuserCommand *frame)
+{
+    unsigned char *bytes = (unsigned char *)frame;
+    int size = sizeof(*frame), nbytes_read = 0;
+
+    while ( linkAvailable() >= size )
+    {
+        if ( (readLink((char *)bytes, size, 1, &nbytes_read) != TTY_OK) || (nbytes_read != size) )
+            return false;
+        if ( (frame->M == 'M') && (calculate_checksum(*frame) == frame->z) )
+            return true;
+
+        // Put back what follows the next header candidate and look again from there
+        const unsigned char *next = (const unsigned char *)memchr(bytes + 1, 'M', size - 1);
+        if ( next != nullptr )
+        {
+            unreadCount = bytes + size - next;
+            memcpy(unreadBytes, next, unreadCount);
+        }
+    }
+    return false;
+}
+
+void DreamFocuser::drainAbandoned()
+{
+    DreamFocuserCommand frame;
+
+    while ( pendingCount > 0 )
+    {
+        PendingRequest &request = pending[pendingHead];
+
+        if ( !request.abandoned || (request.expires <= monotonic_ms()) )
+        {
+            popPending();
+            continue;
+        }
+
+        if ( !readWaitingFrame(&frame) )
+            break;
+
+        reportLinkError(LINK_ERROR_STALE, "Dropped a late '%c' reply to an abandoned '%c' request.", frame.k, request.k);
+        popPending();
+    }
+}
+
+// Start a new exchange with nothing stale left on the line
+void DreamFocuser::flushLink()
+{
+    drainAbandoned();
+    if ( pendingCount > 0 )
+        resyncLink();
+    tcflush(PortFD, TCIOFLUSH);
+    unreadCount = 0;
+}
+
+// Send a batch of requests keeping up to depth frames in flight and read the
+// responses in order. A timeout or short read loses the framing, so the rest
+// of the batch is abandoned then. Returns the number of good responses.
+int DreamFocuser::dispatch_batch(DreamFocuserRequest *requests, int n, int depth, int timeout)
+{
+    int sent = 0, received = 0, answered = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        requests[i].ok = false;
+        requests[i].status = RESPONSE_TIMEOUT;
+    }
+
+    flushLink();
+
+    while ( received < n )
+    {
+        while ( (sent < n) && (sent - received < depth) )
+        {
+            requests[sent].sent = monotonic_ms();
+            if ( !send_command(requests[sent].k, requests[sent].l, requests[sent].addr) )
+            {
+                // Frames already in flight are drained before the next exchange
+                abandonPending();
+                return answered;
+            }
+            sent++;
+        }
+
+        read_response(timeout);
+        requests[received].status = responseStatus;
+        if ( journal.isOpen() )
+            journal.write(JOURNAL_COMMAND, wallclock(), requests[received].k, responseStatus, 0, monotonic_ms() - requests[received].sent);
+        if ( (responseStatus == RESPONSE_TIMEOUT) || (responseStatus == RESPONSE_SHORT) )
+            return answered;
+
+        requests[received].response = currentResponse;
+        requests[received].ok = (responseStatus == RESPONSE_OK) && (currentResponse.k == requests[received].k);
+        if ( requests[received].ok )
+            answered++;
+        received++;
+    }
+
+    return answered;
+}
+
+// Send bursts of harmless version queries at increasing pipeline depths and
+// keep the deepest one that came back without drops or rejected frames.
+bool DreamFocuser::runLinkTest()
+{
+    DreamFocuserRequest burst[DREAMFOCUSER_MAX_PIPELINE];
+    double start, frameMs = 0;
+    int drops = 0, errors = 0, depth = 0;
+
+    LOG_INFO("Running link self-test.");
+
+    for (int d = 1; d <= DREAMFOCUSER_MAX_PIPELINE; d *= 2)
+    {
+        int lost = 0, rejected = 0;
+
+        start = monotonic_ms();
+        for (int round = 0; round < DREAMFOCUSER_LINK_ROUNDS; round++)
+        {
+            for (int i = 0; i < d; i++)
+            {
+                burst[i].k = 'V';
+                burst[i].l = 0;
+                burst[i].addr = 0;
+            }
+            dispatch_batch(burst, d, d, 1);
+
+            for (int i = 0; i < d; i++)
+            {
+                if ( (burst[i].status == RESPONSE_UNKNOWN_COMMAND) || (burst[i].status == RESPONSE_BAD_CHECKSUM) )
+                    rejected++;
+                else if ( !burst[i].ok )
+                    lost++;
+            }
+        }
+        double perFrame = (monotonic_ms() - start) / (d * DREAMFOCUSER_LINK_ROUNDS);
+
+        LOGF_DEBUG("Link test depth %d: %.2f ms per frame, %d dropped, %d rejected.", d, perFrame, lost, rejected);
+
+        if ( d == 1 )
+            LinkTestN[LINK_RTT].value = perFrame;
+        drops += lost;
+        errors += rejected;
+        if ( lost || rejected )
+            break;
+
+        depth = d;
+        frameMs = perFrame;
+    }
+
+    LinkTestN[LINK_DROPS].value = drops;
+    LinkTestN[LINK_REJECTED].value = errors;
+
+    if ( depth == 0 )
+    {
+        LOG_WARN("Link self-test failed even without pipelining.");
+        pipelineDepth = 1;
+        LinkTestN[LINK_DEPTH].value = pipelineDepth;
+        return false;
+    }
+
+    pipelineDepth = depth;
+    LinkTestN[LINK_DEPTH].value = pipelineDepth;
+    LinkTestN[LINK_POLL].value = ceil(2 * DREAMFOCUSER_POLL_FRAMES * frameMs);
+    if ( LinkTestN[LINK_POLL].value < DREAMFOCUSER_MIN_POLL )
+        LinkTestN[LINK_POLL].value = DREAMFOCUSER_MIN_POLL;
+
+    LOGF_INFO("Link self-test: pipeline depth %d, round trip %.2f ms, safe polling period %.f ms.", pipelineDepth, LinkTestN[LINK_RTT].value, LinkTestN[LINK_POLL].value);
+    applySafePolling();
+
+    return true;
+}
+
+// The safe period found by the link test is the floor of every polling period.
+// It is applied in pollPeriod(), the configured periods are kept as set so a
+// faster link later gets them back.
+void DreamFocuser::applySafePolling()
+{
+    for (int i = 0; i < POLL_FIELDS; i++)
+        if ( PollPeriodN[i].value < LinkTestN[LINK_POLL].value )
+            LOGF_INFO("%s polled every %.f ms instead of %.f ms, the safe period for this link.", PollPeriodN[i].label, LinkTestN[LINK_POLL].value, PollPeriodN[i].value);
+
+    if ( isConnected() && !idleMode )
+        for (int i = 0; i < POLL_FIELDS; i++)
+            schedule(&pollTask[i].task, pollPeriod(i), pollPeriod(i));
+}
+
 /****************************************************************
 **
 **
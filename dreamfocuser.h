@@ -28,11 +28,47 @@
 #include <indicom.h>
 #include <indifocuser.h>
 
+#include "timerwheel.h"
+#include "focusmetric.h"
+#include "journal.h"
+#include "focuscurve.h"
+
 using namespace std;
 
 #define DREAMFOCUSER_STEP_SIZE      32
 #define DREAMFOCUSER_ERROR_BUFFER   1024
 
+#define DREAMFOCUSER_SEGMENT_SIZE   1000
+#define DREAMFOCUSER_STALL_RETRIES  3
+#define DREAMFOCUSER_GROUP_SIZE     4
+#define DREAMFOCUSER_GROUP_MARGIN   10000   // ms a group member may run past twice our own move time
+
+#define DREAMFOCUSER_READ_TIMEOUT   5
+#define DREAMFOCUSER_MAX_PIPELINE   8
+#define DREAMFOCUSER_LINK_ROUNDS    4
+#define DREAMFOCUSER_POLL_FRAMES    5
+#define DREAMFOCUSER_MIN_POLL       100
+#define DREAMFOCUSER_STARVATION     4
+#define DREAMFOCUSER_POLL_FIELDS    4
+#define DREAMFOCUSER_DEFAULT_SPEED  1000    // steps per second until a move has been timed
+#define DREAMFOCUSER_ETA_MARGIN     100     // ms
+#define DREAMFOCUSER_STATS_PERIOD   60000   // ms
+#define DREAMFOCUSER_ERROR_SUMMARY  60000   // ms
+#define DREAMFOCUSER_HISTORY_SIZE   4096
+#define DREAMFOCUSER_THERMAL_SIZE   512
+#define DREAMFOCUSER_THERMAL_SPACING 10     // s between stored temperature samples
+#define DREAMFOCUSER_PACKED_FIELDS  7
+#define DREAMFOCUSER_PACKED_SIZE    (2 + DREAMFOCUSER_PACKED_FIELDS * 10)
+#define DREAMFOCUSER_KEYFRAME       30      // packed snapshots between full ones
+#define DREAMFOCUSER_KEYFRAME_PERIOD 10000  // ms, longest gap between full snapshots
+#define DREAMFOCUSER_MAX_PENDING    16      // requests on the wire, at least DREAMFOCUSER_MAX_PIPELINE
+#define DREAMFOCUSER_LATE_WINDOW    500     // ms a timed out request may still answer
+#define DREAMFOCUSER_RESYNC_TIMEOUT 1       // s to wait for the answer to a resync query
+#define DREAMFOCUSER_REOPEN_DELAY   2000    // ms before a port that failed a write is reopened
+#define DREAMFOCUSER_RESUME_TIMEOUT 60000   // ms for the focuser to unpark before a resume fails
+#define DREAMFOCUSER_SETTLE_FRAMES  3       // frames after a stop compared to learn the settle time
+#define DREAMFOCUSER_SETTLE_BLUR    0.05    // HFR excess over the last of them that marks a disturbed frame
+
 
 class DreamFocuser : public INDI::Focuser
 {
@@ -51,14 +87,106 @@ class DreamFocuser : public INDI::Focuser
             unsigned char z;
         };
 
+        enum ResponseStatus
+        {
+            RESPONSE_OK,
+            RESPONSE_TIMEOUT,
+            RESPONSE_SHORT,
+            RESPONSE_CHECKSUM,
+            RESPONSE_UNKNOWN_COMMAND,
+            RESPONSE_BAD_CHECKSUM
+        };
+
+        enum BacklashState
+        {
+            BACKLASH_IDLE,
+            BACKLASH_TO_LOW,
+            BACKLASH_TO_REFERENCE_OUT,
+            BACKLASH_SAMPLE_REFERENCE,
+            BACKLASH_TO_HIGH,
+            BACKLASH_TO_REFERENCE_IN,
+            BACKLASH_SAMPLE_STEP
+        };
+
+        enum RefocusState
+        {
+            REFOCUS_IDLE,
+            REFOCUS_SAMPLE_LOW,
+            REFOCUS_SAMPLE_HIGH,
+            REFOCUS_TO_BEST
+        };
+
+        enum LinkError
+        {
+            LINK_ERROR_WRITE,
+            LINK_ERROR_TIMEOUT,
+            LINK_ERROR_SHORT,
+            LINK_ERROR_CHECKSUM,
+            LINK_ERROR_UNKNOWN_COMMAND,
+            LINK_ERROR_BAD_CHECKSUM,
+            LINK_ERROR_STALE,
+            LINK_ERRORS
+        };
+
+        enum FaultClass
+        {
+            FAULT_DROP,
+            FAULT_CHECKSUM,
+            FAULT_UNKNOWN_COMMAND,
+            FAULT_BAD_CHECKSUM,
+            FAULT_STALL,
+            FAULT_PORT,
+            FAULT_CLASSES
+        };
+
+        struct DreamFocuserRequest
+        {
+            char k;
+            uint32_t l;
+            unsigned char addr;
+            bool ok;
+            ResponseStatus status;
+            DreamFocuserCommand response;
+            double sent;
+        };
+
+        // A request on the wire; abandoned ones expire when their late window closes
+        struct PendingRequest
+        {
+            char k;
+            bool abandoned;
+            double expires;
+        };
+
+        struct PositionSample
+        {
+            double time;
+            int32_t position;
+        };
+
+        struct TemperatureSample
+        {
+            double time;
+            float temperature;
+        };
+
+        struct PollTask
+        {
+            TimerWheel::Task task;
+            DreamFocuser *focuser;
+            int field;
+        };
+
         DreamFocuser();
 
         const char *getDefaultName() override;
         virtual bool initProperties() override;
         virtual bool updateProperties() override;
-        //virtual bool saveConfigItems(FILE *fp) override;
-        //virtual bool ISNewNumber (const char *dev, const char *name, double values[], char *names[], int n) override;
+        virtual bool saveConfigItems(FILE *fp) override;
+        virtual bool ISNewNumber (const char *dev, const char *name, double values[], char *names[], int n) override;
         virtual bool ISNewSwitch (const char *dev, const char *name, ISState *states, char *names[], int n) override;
+        virtual bool ISNewText (const char *dev, const char *name, char *texts[], char *names[], int n) override;
+        virtual bool ISSnoopDevice (XMLEle *root) override;
 
     protected:
         virtual bool Handshake() override;
@@ -71,22 +199,265 @@ class DreamFocuser : public INDI::Focuser
 
     private:
 
+        // The tests drive the link and the scheduler without indiserver
+        friend class DreamFocuserTest;
+
         INumber WeatherN[3];
         INumberVectorProperty WeatherNP;
 
         ISwitch ParkS[2];
         ISwitchVectorProperty ParkSP;
 
-        ISwitch StatusS[3];
+        ISwitch StatusS[4];
         ISwitchVectorProperty StatusSP;
 
-        //INumber SetBacklashN[1];
-        //INumberVectorProperty SetBacklashNP;
+        ISwitch MotionProfileS[3];
+        ISwitchVectorProperty MotionProfileSP;
+
+        INumber MotionProfileN[2];
+        INumberVectorProperty MotionProfileNP;
+
+        IText GroupT[2];
+        ITextVectorProperty GroupTP;
+
+        INumber GroupMoveN[2];
+        INumberVectorProperty GroupMoveNP;
+
+        ISwitch LinkTestS[1];
+        ISwitchVectorProperty LinkTestSP;
+
+        INumber LinkTestN[5];
+        INumberVectorProperty LinkTestNP;
+
+        INumber PollPeriodN[DREAMFOCUSER_POLL_FIELDS];
+        INumberVectorProperty PollPeriodNP;
+
+        ISwitch TicklessS[2];
+        ISwitchVectorProperty TicklessSP;
+
+        INumber TicklessN[2];
+        INumberVectorProperty TicklessNP;
+
+        INumber WakeupStatsN[2];
+        INumberVectorProperty WakeupStatsNP;
+
+        INumber LinkErrorsN[LINK_ERRORS];
+        INumberVectorProperty LinkErrorsNP;
+
+        INumber PositionAtN[2];
+        INumberVectorProperty PositionAtNP;
+
+        IText MetricSourceT[2];
+        ITextVectorProperty MetricSourceTP;
+
+        INumber FocusMetricN[4];
+        INumberVectorProperty FocusMetricNP;
+
+        // Scratch copy of the camera image used while snooping
+        IBLOB SnoopImageB[1];
+        IBLOBVectorProperty SnoopImageBP;
+
+        // Scratch copy of a peer's FOCUS_GROUP_MOVE used while snooping
+        INumber SnoopGroupMoveN[2];
+        INumberVectorProperty SnoopGroupMoveNP;
+
+        INumber SetBacklashN[1];
+        INumberVectorProperty SetBacklashNP;
+
+        ISwitch BacklashMeasureS[2];
+        ISwitchVectorProperty BacklashMeasureSP;
+
+        INumber BacklashMeasureN[3];
+        INumberVectorProperty BacklashMeasureNP;
+
+        ISwitch SettleS[2];
+        ISwitchVectorProperty SettleSP;
+
+        INumber SettleN[3];
+        INumberVectorProperty SettleNP;
+
+        INumber ReadyN[3];
+        INumberVectorProperty ReadyNP;
+
+        INumber ThermalN[2];
+        INumberVectorProperty ThermalNP;
+
+        INumber ThermalStateN[3];
+        INumberVectorProperty ThermalStateNP;
+
+        ISwitch DriftS[3];
+        ISwitchVectorProperty DriftSP;
+
+        INumber DriftN[4];
+        INumberVectorProperty DriftNP;
+
+        INumber DriftStateN[4];
+        INumberVectorProperty DriftStateNP;
+
+        ISwitch JournalS[2];
+        ISwitchVectorProperty JournalSP;
+
+        IText JournalT[1];
+        ITextVectorProperty JournalTP;
+
+        ISwitch PackedStatusS[2];
+        ISwitchVectorProperty PackedStatusSP;
+
+        IBLOB PackedStatusB[1];
+        IBLOBVectorProperty PackedStatusBP;
+
+        INumber ParkMemoryN[3];
+        INumberVectorProperty ParkMemoryNP;
+
+        IText ParkSourceT[1];
+        ITextVectorProperty ParkSourceTP;
+
+        INumber TempCompensationN[1];
+        INumberVectorProperty TempCompensationNP;
+
+        ISwitch ResumeS[1];
+        ISwitchVectorProperty ResumeSP;
+
+        ISwitch FocusCurveS[2];
+        ISwitchVectorProperty FocusCurveSP;
+
+        ISwitch FocusCurveMoveS[1];
+        ISwitchVectorProperty FocusCurveMoveSP;
+
+        INumber FocusCurveN[1];
+        INumberVectorProperty FocusCurveNP;
+
+        INumber FocusCurveResultN[8];
+        INumberVectorProperty FocusCurveResultNP;
+
+        ISwitch FaultS[FAULT_CLASSES + 1];
+        ISwitchVectorProperty FaultSP;
+
+        INumber FaultN[1];
+        INumberVectorProperty FaultNP;
+
+        INumber FaultResultsN[3 * FAULT_CLASSES];
+        INumberVectorProperty FaultResultsNP;
+
+        IText WeatherSourceT[3];
+        ITextVectorProperty WeatherSourceTP;
+
+        INumber WeatherCheckN[3];
+        INumberVectorProperty WeatherCheckNP;
+
+        INumber SensorN[3];
+        INumberVectorProperty SensorNP;
 
         unsigned char calculate_checksum(DreamFocuserCommand c);
         bool send_command(char k, uint32_t l = 0, unsigned char addr = 0);
-        bool read_response();
+        bool read_response(int timeout = DREAMFOCUSER_READ_TIMEOUT);
+        int readLink(char *buffer, int size, int timeout, int *nbytes_read);
         bool dispatch_command(char k, uint32_t l = 0, unsigned char addr = 0);
+        int dispatch_batch(DreamFocuserRequest *requests, int n, int depth, int timeout = DREAMFOCUSER_READ_TIMEOUT);
+        bool runLinkTest();
+        void applySafePolling();
+
+        void pushPending(char k);
+        void popPending();
+        void abandonPending();
+        int linkAvailable();
+        bool readWaitingFrame(DreamFocuserCommand *frame);
+        void drainAbandoned();
+        void resyncLink();
+        void flushLink();
+
+        bool dispatch_interactive(char k, uint32_t l = 0, unsigned char addr = 0);
+        void requestPoll(int fields);
+        void startPoll();
+        void addPollRequest(char k, unsigned char addr = 0);
+        DreamFocuserRequest *polled(char k);
+        void runPollSlice();
+        void finishPoll();
+
+        void startScheduler();
+        void stopScheduler();
+        void armScheduler();
+        void schedule(TimerWheel::Task *task, uint32_t delay, uint32_t period = 0);
+        static void pollTaskHelper(void *context);
+        static void pollSliceHelper(void *context);
+        static void moveEtaHelper(void *context);
+        static void statsHelper(void *context);
+        uint32_t pollPeriod(int field);
+
+        bool isIdle();
+        void updateIdle();
+        void wakeUp();
+        void startHotplug();
+        void stopHotplug();
+        static void hotplugHelper(int fd, void *context);
+        void hotplugEvent();
+        void updateWakeupStats();
+
+        void reportLinkError(LinkError error, const char *format, ...);
+        void summarizeLinkErrors();
+        static void errorSummaryHelper(void *context);
+        void reopenPort();
+        static void reopenHelper(void *context);
+
+        void recordPosition(int32_t position);
+        bool positionAt(double time, double *position);
+
+        void updateMetricSource();
+        bool measureImage(const IBLOB *image);
+
+        bool startBacklashMeasurement();
+        void stopBacklashMeasurement(IPState state);
+        void backlashMove(int32_t position, BacklashState next);
+        void advanceBacklashMeasurement(bool sampled);
+
+        void startSettle();
+        void checkSettle();
+        void learnSettle();
+        static void settleHelper(void *context);
+
+        void recordTemperature(float temperature);
+        bool temperatureSlope(double from, double to, double *slope);
+        void updateThermal();
+
+        void resetDrift();
+        void updateDrift();
+        void refocusMove(int32_t position, RefocusState next);
+        void advanceRefocus();
+
+        void updateJournal();
+
+        void publishPackedStatus();
+        static void packedKeyHelper(void *context);
+        void queuePackedStatus();
+
+        void rememberPark();
+        const char *temperatureSource();
+        bool startResume();
+        void checkResume();
+        void stopResume(IPState state);
+        static void resumeTimeoutHelper(void *context);
+        void failResume();
+
+        void addCurveSample();
+
+        void startFault(int fault);
+        bool injectFault(bool sending);
+        int readFaulty(int timeout, int *nbytes_read);
+        void checkFaultRecovery();
+
+        void updateWeatherSource();
+        void snoopWeather(XMLEle *root);
+        void setExternalWeather(bool active);
+        static void weatherStaleHelper(void *context);
+        void loseExternalWeather();
+        void checkSensor();
+        void updateWeather();
+
+        void decodeTemperature(const DreamFocuserCommand &r);
+        void decodeStatus(const DreamFocuserCommand &r);
+        void decodeAbsolute(const DreamFocuserCommand &r);
+        void decodePosition(const DreamFocuserCommand &r);
+        void decodeMaxPosition(const DreamFocuserCommand &r);
 
         bool getTemperature();
         bool getStatus();
@@ -96,6 +467,18 @@ class DreamFocuser : public INDI::Focuser
         bool setSync(uint32_t position = 0);
         bool setPark();
 
+        bool isReducedProfile();
+        bool startMove(int32_t position, bool compensate = true);
+        bool moveSegment();
+        void checkMove();
+
+        void updateGroup();
+        bool startGroupMove(int32_t offset, int sequence);
+        void checkGroupMove();
+        void finishGroupMove(IPState state);
+        static void groupDeadlineHelper(void *context);
+        void expireGroupMove();
+
        // Variables
         float currentTemperature;
         float currentHumidity;
@@ -105,6 +488,149 @@ class DreamFocuser : public INDI::Focuser
         bool isMoving;
         unsigned char isParked;
         bool isVcc12V;
+        bool moveInProgress;
+        int32_t targetPosition;
+        int32_t finalPosition;
+        int32_t segmentPosition;
+        int moveRetries;
+        bool groupMoveActive;
+        int groupSequence;
+        int leaderSequence;
+        int groupMembers;
+        char groupMember[DREAMFOCUSER_GROUP_SIZE][MAXINDINAME];
+        IPState groupMemberState[DREAMFOCUSER_GROUP_SIZE];
+        TimerWheel::Task groupDeadlineTask;
+        int pipelineDepth;
+
+        // Periodic and one-shot work runs from a timer wheel behind a single event loop timer
+        TimerWheel scheduler;
+        int schedulerTimerID;
+        PollTask pollTask[DREAMFOCUSER_POLL_FIELDS];
+        TimerWheel::Task pollSliceTask;
+        TimerWheel::Task moveEtaTask;
+        double moveSpeed;
+        double moveStartTime;
+        double moveSeenTime;        // last poll that found the motor running
+        int32_t moveStartPosition;
+        TimerWheel::Task statsTask;
+        bool idleMode;
+        double lastActivity;
+        unsigned long wakeups;
+        bool inTick;
+        // Heap allocations inside ticks, only counted with DREAMFOCUSER_ALLOC_CHECK
+        unsigned long allocatingTicks;
+        unsigned long tickAllocations;
+        double allocationWarning;
+        double statsStartTime;
+        double statsStartCPU;
+        int hotplugFD;
+        int hotplugWatch;
+        int hotplugCallbackID;
+        TimerWheel::Task errorSummaryTask;
+        TimerWheel::Task reopenTask;
+        unsigned long suppressedErrors[LINK_ERRORS];
+        bool errorReported[LINK_ERRORS];
+
+        // Requests sent and not answered yet, in the order the focuser answers them
+        PendingRequest pending[DREAMFOCUSER_MAX_PENDING];
+        int pendingHead;
+        int pendingCount;
+        // Bytes taken off the port but not consumed yet, the next read gets them first
+        unsigned char unreadBytes[sizeof(DreamFocuserCommand)];
+        int unreadCount;
+
+        // Ring buffer of timestamped positions, a stationary run is kept as its first and last sample
+        PositionSample positionHistory[DREAMFOCUSER_HISTORY_SIZE];
+        int historyStart;
+        int historyCount;
+
+        FocusMetric focusMetric;
+        double metricHFR;
+        double metricTime;
+        int32_t metricPosition;
+        bool frameAtRest;
+
+        // Backlash measurement, driven by move arrivals and new focus metric samples
+        BacklashState backlashState;
+        int32_t backlashReference;
+        int backlashSteps;
+        double backlashReferenceHFR;
+        double backlashPreviousHFR;
+
+        // Settling after a move, READY is published once the position holds still
+        TimerWheel::Task settleTask;
+        bool settling;
+        int settleSamples;
+        int32_t settlePosition;
+        double settleStopTime;
+        double settleLastChange;
+        double learnedSettle;
+        double settleStopWall;
+        double restWall;
+        bool restFrameSeen;
+        int settleFrames;
+        double settleFrameStart[DREAMFOCUSER_SETTLE_FRAMES];
+        double settleFrameHFR[DREAMFOCUSER_SETTLE_FRAMES];
+
+        // Ring buffer of temperature samples for the thermal equilibrium estimate
+        TemperatureSample thermalHistory[DREAMFOCUSER_THERMAL_SIZE];
+        int thermalStart;
+        int thermalCount;
+
+        // Focus drift monitor, a one sided CUSUM of the HFR against a baseline at the current position
+        int32_t driftPosition;
+        int driftFrames;
+        double driftSum;
+        double driftSumSquares;
+        double driftCusum;
+        RefocusState refocusState;
+        int32_t refocusCenter;
+        double refocusCenterHFR;
+        double refocusLowHFR;
+
+        // Event journal for the offline analyzer
+        Journal journal;
+
+        // Packed status snapshots, deltas against the last one sent
+        int64_t packedLast[DREAMFOCUSER_PACKED_FIELDS];
+        int packedSinceKey;
+        bool packedDue;
+        TimerWheel::Task packedKeyTask;
+        unsigned char packedStatus[DREAMFOCUSER_PACKED_SIZE];
+
+        bool resumePending;
+        TimerWheel::Task resumeTask;
+
+        // Focus sweep samples, only frames taken at rest are added
+        FocusCurve focusCurve;
+
+        // Fault injection run, faultClass is -1 when none is active
+        int faultClass;
+        bool faultSequence;
+        int faultRemaining;
+        double faultStart;
+        int faultLostPolls;
+        int faultLostUpdates;
+
+        // Ambient weather snooped from another device, the focuser's sensor is then only a cross-check
+        bool externalWeather;
+        bool weatherResolved;
+        float externalTemperature;
+        float externalHumidity;
+        TimerWheel::Task weatherStaleTask;
+
+        // Background polling, run in slices so interactive commands can go in between
+        DreamFocuserRequest pollRequests[DREAMFOCUSER_POLL_FRAMES];
+        int pollDue;
+        int pollFields;
+        int pollCount;
+        int pollNext;
+        int interactiveStreak;
+        int moveGeneration;
+        int pollMoveGeneration;
+        IPState pollOldAbsStatus;
+        int32_t pollOldPosition;
+        ResponseStatus responseStatus;
         DreamFocuserCommand currentResponse;
 };
 
@@ -0,0 +1,76 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+  Steady state polling must not allocate. The driver polls a fake focuser
+  for a few thousand ticks with the counting allocator built in and the
+  test fails on any allocation inside a tick.
+*/
+
+#include <stdio.h>
+
+#include "fakefocuser.h"
+#include "dreamfocuser_test.h"
+
+#define TEST_WARMUP     100
+#define TEST_TICKS      3000
+
+int main()
+{
+    FakeFocuser fake;
+    DreamFocuser focuser;
+
+    // Property updates would flood the test log
+    if ( freopen("/dev/null", "w", stdout) == nullptr )
+        return 1;
+
+    if ( !fake.start() )
+    {
+        fprintf(stderr, "Can not open a pseudo terminal.\n");
+        return 1;
+    }
+    if ( !DreamFocuserTest::connect(focuser, fake.fd()) )
+    {
+        fprintf(stderr, "Handshake with the fake focuser failed.\n");
+        return 1;
+    }
+    DreamFocuserTest::pollFast(focuser);
+
+    // First use of stdio buffers, the logger and the link test results may allocate
+    for (int i = 0; i < TEST_WARMUP; i++)
+        DreamFocuserTest::tick(focuser);
+
+    unsigned long requests = fake.requests();
+    unsigned long allocations = DreamFocuserTest::tickAllocations(focuser);
+    unsigned long ticks = DreamFocuserTest::allocatingTicks(focuser);
+
+    for (int i = 0; i < TEST_TICKS; i++)
+        DreamFocuserTest::tick(focuser);
+
+    requests = fake.requests() - requests;
+    allocations = DreamFocuserTest::tickAllocations(focuser) - allocations;
+    ticks = DreamFocuserTest::allocatingTicks(focuser) - ticks;
+    fprintf(stderr, "%d ticks, %lu requests, %lu heap allocations in %lu ticks\n", TEST_TICKS, requests, allocations, ticks);
+
+    DreamFocuserTest::disconnect(focuser);
+    fake.stop();
+    return (requests > 0) && (allocations == 0) ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+  Offline analyzer for DreamFocuser journals. Journals are streamed through
+  a sliding memory mapped window, so multi-gigabyte files need constant
+  memory. Reports command latency percentiles, error rates over
+  time, a move time against distance fit, temperature regressions of the
+  focus position and HFR, and scheduler tick percentiles.
+
+  Usage: dreamfocuser_analyze [-b bucket_seconds] journal...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+
+#include "journal.h"
+
+#define ANALYZE_BINS        800         // log histogram, 100 bins per decade from 1 us
+#define ANALYZE_BIN_OFFSET  300
+#define ANALYZE_COMMANDS    128
+
+// Latency histogram with 1 % wide logarithmic bins
+struct Histogram
+{
+    unsigned long bins[ANALYZE_BINS];
+    unsigned long count;
+    double sum;
+    double max;
+
+    Histogram()
+    {
+        memset(bins, 0, sizeof(bins));
+        count = 0;
+        sum = max = 0;
+    }
+
+    void add(double ms)
+    {
+        int bin = ms > 0 ? (int)floor(log10(ms) * 100) + ANALYZE_BIN_OFFSET : 0;
+        if ( bin < 0 )
+            bin = 0;
+        if ( bin >= ANALYZE_BINS )
+            bin = ANALYZE_BINS - 1;
+        bins[bin]++;
+        count++;
+        sum += ms;
+        if ( ms > max )
+            max = ms;
+    }
+
+    double percentile(double p) const
+    {
+        unsigned long rank = (unsigned long)ceil(p / 100 * count), seen = 0;
+        for (int i = 0; i < ANALYZE_BINS; i++)
+        {
+            seen += bins[i];
+            if ( seen >= rank && seen > 0 )
+                return pow(10, (i + 0.5 - ANALYZE_BIN_OFFSET) / 100.);
+        }
+        return max;
+    }
+};
+
+// Running least squares fit of y = a + b * x
+struct Regression
+{
+    double n, sx, sy, sxx, sxy, syy;
+
+    Regression()
+    {
+        n = sx = sy = sxx = sxy = syy = 0;
+    }
+
+    void add(double x, double y)
+    {
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+    }
+
+    bool fit(double *a, double *b, double *r) const
+    {
+        double dx = n * sxx - sx * sx, dy = n * syy - sy * sy;
+        if ( (n < 3) || (dx <= 0) )
+            return false;
+        *b = (n * sxy - sx * sy) / dx;
+        *a = (sy - *b * sx) / n;
+        *r = dy > 0 ? (n * sxy - sx * sy) / sqrt(dx * dy) : 0;
+        return true;
+    }
+};
+
+struct Bucket
+{
+    unsigned long commands;
+    unsigned long errors;
+};
+
+struct Analysis
+{
+    Histogram latency[ANALYZE_COMMANDS];
+    unsigned long errors[ANALYZE_COMMANDS];
+    std::map<long, Bucket> buckets;
+    Regression moves;
+    Regression positionTemperature;
+    Regression hfrTemperature;
+    Histogram ticks;
+    unsigned long records;
+    double first;
+    double last;
+
+    Analysis()
+    {
+        memset(errors, 0, sizeof(errors));
+        records = 0;
+        first = last = 0;
+    }
+};
+
+static void analyzeRecord(Analysis &analysis, const JournalRecord &record, int bucketSeconds)
+{
+    if ( analysis.records++ == 0 || record.time < analysis.first )
+        analysis.first = record.time;
+    if ( record.time > analysis.last )
+        analysis.last = record.time;
+
+    switch (record.type)
+    {
+        case JOURNAL_COMMAND:
+        {
+            int k = record.command & (ANALYZE_COMMANDS - 1);
+            Bucket &bucket = analysis.buckets[(long)floor(record.time / bucketSeconds)];
+            bucket.commands++;
+            if ( record.status != 0 )
+            {
+                bucket.errors++;
+                analysis.errors[k]++;
+            }
+            else
+                analysis.latency[k].add(record.value);
+            break;
+        }
+
+        case JOURNAL_MOVE:
+            if ( record.status == 0 )
+                analysis.moves.add(record.position, record.value - record.extra);
+            break;
+
+        case JOURNAL_FOCUS:
+            analysis.positionTemperature.add(record.value, record.position);
+            analysis.hfrTemperature.add(record.value, record.extra);
+            break;
+
+        case JOURNAL_TICK:
+            analysis.ticks.add(record.value);
+            break;
+    }
+}
+
+struct Scan
+{
+    Analysis *analysis;
+    int bucketSeconds;
+};
+
+static void analyzeHelper(const JournalRecord &record, void *context)
+{
+    Scan *scan = static_cast<Scan *>(context);
+
+    analyzeRecord(*scan->analysis, record, scan->bucketSeconds);
+}
+
+static void report(const Analysis &analysis, int bucketSeconds)
+{
+    double a, b, r;
+    char when[32];
+    time_t t;
+
+    printf("Records: %lu over %.1f h\n", analysis.records, (analysis.last - analysis.first) / 3600);
+
+    printf("\nCommand latency [ms]\n");
+    printf("  cmd      count   errors      p50      p90      p99      max\n");
+    for (int k = 0; k < ANALYZE_COMMANDS; k++)
+    {
+        const Histogram &h = analysis.latency[k];
+        if ( h.count == 0 && analysis.errors[k] == 0 )
+            continue;
+        printf("  %c   %10lu %8lu %8.2f %8.2f %8.2f %8.2f\n", k, h.count, analysis.errors[k],
+               h.percentile(50), h.percentile(90), h.percentile(99), h.max);
+    }
+
+    printf("\nErrors per %d s\n", bucketSeconds);
+    for (std::map<long, Bucket>::const_iterator i = analysis.buckets.begin(); i != analysis.buckets.end(); ++i)
+    {
+        if ( i->second.errors == 0 )
+            continue;
+        t = i->first * bucketSeconds;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+        printf("  %s  %8lu / %-8lu %6.2f %%\n", when, i->second.errors, i->second.commands, 100. * i->second.errors / i->second.commands);
+    }
+
+    printf("\nMove time against distance\n");
+    if ( analysis.moves.fit(&a, &b, &r) && b > 0 )
+        printf("  %.0f moves: %.1f ms + %.3f ms/step (%.0f steps/s), r = %.3f\n", analysis.moves.n, a, b, 1000 / b, r);
+    else
+        printf("  not enough moves\n");
+
+    printf("\nTemperature regressions\n");
+    if ( analysis.positionTemperature.fit(&a, &b, &r) )
+        printf("  position: %.1f steps/C, r = %.3f over %.0f frames\n", b, r, analysis.positionTemperature.n);
+    else
+        printf("  not enough frames\n");
+    if ( analysis.hfrTemperature.fit(&a, &b, &r) )
+        printf("  HFR: %.3f px/C, r = %.3f\n", b, r);
+
+    printf("\nScheduler ticks [ms]\n");
+    if ( analysis.ticks.count > 0 )
+        printf("  %lu ticks: p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n", analysis.ticks.count,
+               analysis.ticks.percentile(50), analysis.ticks.percentile(90), analysis.ticks.percentile(99),
+               analysis.ticks.percentile(99.9), analysis.ticks.max);
+    else
+        printf("  no ticks\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int bucketSeconds = 3600, files = 0, opt;
+
+    while ( (opt = getopt(argc, argv, "b:")) != -1 )
+    {
+        if ( opt == 'b' && atoi(optarg) > 0 )
+            bucketSeconds = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-b bucket_seconds] journal...\n", argv[0]);
+            return 2;
+        }
+    }
+    if ( optind >= argc )
+    {
+        fprintf(stderr, "Usage: %s [-b bucket_seconds] journal...\n", argv[0]);
+        return 2;
+    }
+
+    // Histograms are large, keep them off the stack
+    Analysis *analysis = new Analysis;
+    Scan scan = { analysis, bucketSeconds };
+    for (int i = optind; i < argc; i++)
+        if ( Journal::scan(argv[i], analyzeHelper, &scan) )
+            files++;
+
+    if ( files > 0 )
+        report(*analysis, bucketSeconds);
+    delete analysis;
+    return files > 0 ? 0 : 1;
+}
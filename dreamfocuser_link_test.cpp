@@ -0,0 +1,94 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+  Recovery after a timed out request. The fake focuser answers one 'P' late
+  in the first case and never in the second; either way the next 'P' must
+  get its own answer, not the stale one, and without waiting out another
+  read timeout.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "fakefocuser.h"
+#include "dreamfocuser_test.h"
+
+#define TEST_LATE       300     // ms a late reply comes after the driver gave up
+#define TEST_RECOVERY   2000    // ms the next exchange may take at most
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000. + ts.tv_nsec / 1e6;
+}
+
+static bool recovers(DreamFocuser &focuser, FakeFocuser &fake, const char *name)
+{
+    int32_t position = 0;
+
+    fake.setPosition(100);
+    if ( DreamFocuserTest::readPosition(focuser, &position) )
+    {
+        fprintf(stderr, "%s: the scripted request was answered in time\n", name);
+        return false;
+    }
+
+    fake.setPosition(200);
+    double start = now();
+    bool ok = DreamFocuserTest::readPosition(focuser, &position);
+    double elapsed = now() - start;
+
+    fprintf(stderr, "%s: next request %s, position %d, %.f ms\n", name, ok ? "answered" : "failed", position, elapsed);
+    return ok && (position == 200) && (elapsed < TEST_RECOVERY);
+}
+
+int main()
+{
+    FakeFocuser fake;
+    DreamFocuser focuser;
+    bool ok = true;
+
+    if ( freopen("/dev/null", "w", stdout) == nullptr )
+        return 1;
+
+    if ( !fake.start() )
+    {
+        fprintf(stderr, "Can not open a pseudo terminal.\n");
+        return 1;
+    }
+    if ( !DreamFocuserTest::connect(focuser, fake.fd()) )
+    {
+        fprintf(stderr, "Handshake with the fake focuser failed.\n");
+        return 1;
+    }
+
+    fake.delayNext('P', DREAMFOCUSER_READ_TIMEOUT * 1000 + TEST_LATE);
+    ok &= recovers(focuser, fake, "late reply");
+
+    fake.loseNext('P');
+    ok &= recovers(focuser, fake, "lost reply");
+
+    DreamFocuserTest::disconnect(focuser);
+    fake.stop();
+    return ok ? 0 : 1;
+}
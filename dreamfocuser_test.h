@@ -0,0 +1,95 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef DREAMFOCUSER_TEST_H
+#define DREAMFOCUSER_TEST_H
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "dreamfocuser.h"
+
+#define DREAMFOCUSER_TEST_PERIOD    50      // ms, the shortest polling period the driver accepts
+
+/*
+  Test access to the driver. The driver is connected to a fake focuser the
+  way Connection::Serial would connect it, and since no event loop runs the
+  ticks are delivered by hand when the scheduler's next task is due.
+*/
+class DreamFocuserTest
+{
+
+    public:
+
+        static bool connect(DreamFocuser &focuser, int fd)
+        {
+            focuser.initProperties();
+            focuser.PortFD = fd;
+            if ( !focuser.Handshake() )
+                return false;
+            focuser.setConnected(true, IPS_OK);
+            focuser.updateProperties();
+            return true;
+        }
+
+        static void disconnect(DreamFocuser &focuser)
+        {
+            focuser.setConnected(false, IPS_IDLE);
+            focuser.updateProperties();
+        }
+
+        // Every field at the shortest period, phases spread so most ticks poll one field
+        static void pollFast(DreamFocuser &focuser)
+        {
+            focuser.TicklessS[0].s = ISS_OFF;
+            focuser.TicklessS[1].s = ISS_ON;
+            for (int i = 0; i < DREAMFOCUSER_POLL_FIELDS; i++)
+            {
+                focuser.PollPeriodN[i].value = DREAMFOCUSER_TEST_PERIOD;
+                focuser.scheduler.schedule(&focuser.pollTask[i].task, i * DREAMFOCUSER_TEST_PERIOD / DREAMFOCUSER_POLL_FIELDS,
+                                           DREAMFOCUSER_TEST_PERIOD);
+            }
+        }
+
+        static void tick(DreamFocuser &focuser)
+        {
+            int64_t delay = focuser.scheduler.nextDelay();
+
+            if ( delay > 0 )
+                usleep(delay * 1000);
+            focuser.TimerHit();
+        }
+
+        static unsigned long tickAllocations(const DreamFocuser &focuser) { return focuser.tickAllocations; }
+        static unsigned long allocatingTicks(const DreamFocuser &focuser) { return focuser.allocatingTicks; }
+
+        // One exchange as a client command makes it, the decoded position when it succeeded
+        static bool readPosition(DreamFocuser &focuser, int32_t *position)
+        {
+            if ( !focuser.dispatch_command('P') )
+                return false;
+            focuser.decodePosition(focuser.currentResponse);
+            *position = focuser.currentPosition;
+            return true;
+        }
+};
+
+#endif
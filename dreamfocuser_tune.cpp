@@ -0,0 +1,350 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+  Polling policy autotuner. Replays the moves and parks recorded in driver
+  journals against a model of the driver's scheduler and scores a grid of
+  polling policies on serial traffic, wakeups, move completion latency and
+  staleness of the polled fields. The best policy is written as an INDI
+  config fragment that can be merged into the driver's config file.
+
+  Usage: dreamfocuser_tune [-d device] [-o file] [-t w] [-c w] [-l w] [-s w] journal...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "journal.h"
+
+#define TUNE_RESOLUTION     10      // ms, the timer wheel tick
+#define TUNE_ETA_MARGIN     100     // ms, as in the driver
+#define TUNE_DEFAULT_SPEED  1000    // steps per second without recorded moves
+#define TUNE_FIELDS         4
+#define TUNE_SHOW           5
+
+enum TuneField
+{
+    TUNE_STATUS,
+    TUNE_POSITION,
+    TUNE_TEMPERATURE,
+    TUNE_MAXPOS
+};
+
+// Frames one poll of a field costs, status is 'I' and 'W'
+static const int fieldFrames[TUNE_FIELDS] = { 2, 1, 1, 1 };
+
+struct Activity
+{
+    double start;           // s
+    double duration;        // ms of motor time, 0 for parks
+    int32_t distance;
+};
+
+struct Session
+{
+    std::vector<Activity> activity;
+    double first;
+    double last;
+    double moveSpeed;
+    double sx, sy, sxx, sxy, n;
+};
+
+struct Policy
+{
+    double period[TUNE_FIELDS];     // ms
+    double grace;                   // s
+    double keepalive;               // s
+    double traffic;                 // frames/s
+    double wakeups;                 // per s
+    double latency;                 // ms
+    double staleness;               // s, mean age of status and temperature
+    double score;
+};
+
+static void collect(const JournalRecord &record, void *context)
+{
+    Session *session = static_cast<Session *>(context);
+    Activity activity;
+
+    if ( session->first == 0 || record.time < session->first )
+        session->first = record.time;
+    if ( record.time > session->last )
+        session->last = record.time;
+
+    if ( record.type == JOURNAL_MOVE )
+    {
+        // The recorded duration runs until the driver noticed the arrival, the
+        // delay of the recording policy is taken off to leave the motor time
+        activity.duration = record.value - record.extra;
+        activity.start = record.time - record.value / 1000;
+        activity.distance = record.position;
+        session->activity.push_back(activity);
+        if ( record.status == 0 )
+        {
+            session->n++;
+            session->sx += record.position;
+            session->sy += activity.duration;
+            session->sxx += (double)record.position * record.position;
+            session->sxy += record.position * activity.duration;
+        }
+    }
+    else if ( record.type == JOURNAL_PARK )
+    {
+        activity.duration = 0;
+        activity.start = record.time;
+        activity.distance = 0;
+        session->activity.push_back(activity);
+    }
+}
+
+static long gcd(long a, long b)
+{
+    while ( b )
+    {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static long lcm(long a, long b)
+{
+    return a / gcd(a, b) * b;
+}
+
+static long ticks(double ms)
+{
+    long t = lround(ms / TUNE_RESOLUTION);
+    return t < 1 ? 1 : t;
+}
+
+// Distinct timer wheel wakeups per second for tasks started together,
+// tasks due in the same tick share one wakeup
+static double wakeupRate(const double *period)
+{
+    double rate = 0;
+
+    for (int mask = 1; mask < (1 << TUNE_FIELDS); mask++)
+    {
+        long l = 1;
+        int bits = 0;
+        for (int i = 0; i < TUNE_FIELDS; i++)
+            if ( mask & (1 << i) )
+            {
+                l = lcm(l, ticks(period[i]));
+                bits++;
+            }
+        rate += (bits & 1 ? 1. : -1.) / (l * TUNE_RESOLUTION / 1000.);
+    }
+    return rate;
+}
+
+/*
+  The driver polls every field at its period while active. It turns idle
+  grace seconds after the last activity and then polls every field at the
+  keep-alive period at most. A move is noticed at the arrival check, timed
+  from the learned speed, or at the first poll holding both status and
+  position, whichever comes first.
+*/
+static void evaluate(Policy &policy, const Session &session)
+{
+    double idlePeriod[TUNE_FIELDS], activeTime = 0, latency = 0, activeEnd = 0;
+    double span = session.last - session.first;
+    int moves = 0;
+
+    for (int i = 0; i < TUNE_FIELDS; i++)
+        idlePeriod[i] = std::max(policy.period[i], policy.keepalive * 1000);
+
+    double detection = lcm(ticks(policy.period[TUNE_STATUS]), ticks(policy.period[TUNE_POSITION])) * TUNE_RESOLUTION;
+
+    for (size_t i = 0; i < session.activity.size(); i++)
+    {
+        const Activity &a = session.activity[i];
+        double end = a.start + a.duration / 1000;
+
+        if ( a.duration > 0 )
+        {
+            // Expected delay to the first of the arrival check and a uniformly phased poll
+            double eta = a.distance * 1000. / session.moveSpeed + TUNE_ETA_MARGIN - a.duration;
+            double delay = eta < 0 || eta >= detection ? detection / 2 : eta - eta * eta / (2 * detection);
+            latency += delay;
+            end += delay / 1000;
+            moves++;
+        }
+
+        // Active from the start until grace after the move was noticed, overlaps merge
+        double from = std::max(a.start, activeEnd);
+        double to = end + policy.grace;
+        if ( to > from )
+            activeTime += to - from;
+        activeEnd = std::max(activeEnd, to);
+    }
+
+    if ( activeTime > span )
+        activeTime = span;
+    double active = span > 0 ? activeTime / span : 1;
+
+    policy.traffic = 0;
+    policy.staleness = 0;
+    for (int i = 0; i < TUNE_FIELDS; i++)
+        policy.traffic += fieldFrames[i] * (active * 1000 / policy.period[i] + (1 - active) * 1000 / idlePeriod[i]);
+    policy.traffic += moves * 3 / std::max(span, 1.);
+    policy.wakeups = active * wakeupRate(policy.period) + (1 - active) * wakeupRate(idlePeriod);
+    policy.latency = moves > 0 ? latency / moves : 0;
+    policy.staleness = (active * (policy.period[TUNE_STATUS] + policy.period[TUNE_TEMPERATURE]) +
+                        (1 - active) * (idlePeriod[TUNE_STATUS] + idlePeriod[TUNE_TEMPERATURE])) / 2 / 1000 / 2;
+}
+
+static void writeConfig(FILE *fp, const Policy &policy, const char *device)
+{
+    const char *names[TUNE_FIELDS] = { "STATUS", "POSITION", "TEMPERATURE", "MAXPOSITION" };
+
+    fprintf(fp, "<INDIDriver>\n");
+    fprintf(fp, "<newNumberVector device='%s' name='POLL_PERIODS'>\n", device);
+    for (int i = 0; i < TUNE_FIELDS; i++)
+        fprintf(fp, "  <oneNumber name='%s'>\n      %.f\n  </oneNumber>\n", names[i], policy.period[i]);
+    fprintf(fp, "</newNumberVector>\n");
+    fprintf(fp, "<newSwitchVector device='%s' name='TICKLESS_IDLE'>\n", device);
+    fprintf(fp, "  <oneSwitch name='ENABLE'>\n      On\n  </oneSwitch>\n  <oneSwitch name='DISABLE'>\n      Off\n  </oneSwitch>\n");
+    fprintf(fp, "</newSwitchVector>\n");
+    fprintf(fp, "<newNumberVector device='%s' name='TICKLESS_SETTINGS'>\n", device);
+    fprintf(fp, "  <oneNumber name='GRACE'>\n      %.f\n  </oneNumber>\n", policy.grace);
+    fprintf(fp, "  <oneNumber name='KEEPALIVE'>\n      %.f\n  </oneNumber>\n", policy.keepalive);
+    fprintf(fp, "</newNumberVector>\n");
+    fprintf(fp, "</INDIDriver>\n");
+}
+
+static bool byStart(const Activity &a, const Activity &b)
+{
+    return a.start < b.start;
+}
+
+static bool byScore(const Policy &a, const Policy &b)
+{
+    return a.score < b.score;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-d device] [-o file] [-t w] [-c w] [-l w] [-s w] journal...\n", name);
+    fprintf(stderr, "  weights: -t traffic per frame/s, -c per wakeup/s, -l per 100 ms move latency, -s per 10 s staleness\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const double statusPeriods[] = { 250, 500, 1000, 2000 };
+    const double positionPeriods[] = { 250, 500, 1000, 2000 };
+    const double temperaturePeriods[] = { 2000, 5000, 10000, 30000 };
+    const double maxPositionPeriods[] = { 5000, 30000, 60000 };
+    const double graces[] = { 5, 10, 30, 60 };
+    const double keepalives[] = { 10, 30, 60, 120 };
+    const char *device = "DreamFocuser", *output = nullptr;
+    double wTraffic = 1, wCPU = 1, wLatency = 1, wStaleness = 1;
+    int files = 0, opt;
+    Session session;
+
+    while ( (opt = getopt(argc, argv, "d:o:t:c:l:s:")) != -1 )
+    {
+        switch (opt)
+        {
+            case 'd': device = optarg; break;
+            case 'o': output = optarg; break;
+            case 't': wTraffic = atof(optarg); break;
+            case 'c': wCPU = atof(optarg); break;
+            case 'l': wLatency = atof(optarg); break;
+            case 's': wStaleness = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if ( optind >= argc )
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    session.first = session.last = 0;
+    session.sx = session.sy = session.sxx = session.sxy = session.n = 0;
+    for (int i = optind; i < argc; i++)
+        if ( Journal::scan(argv[i], collect, &session) )
+            files++;
+    if ( files == 0 )
+        return 1;
+
+    std::sort(session.activity.begin(), session.activity.end(), byStart);
+
+    // The driver learns the speed from moves, the fit's slope is the same estimate
+    double d = session.n * session.sxx - session.sx * session.sx;
+    double slope = d > 0 ? (session.n * session.sxy - session.sx * session.sy) / d : 0;
+    session.moveSpeed = slope > 0 ? 1000 / slope : TUNE_DEFAULT_SPEED;
+
+    fprintf(stderr, "Replaying %zu moves and parks over %.1f h, speed %.0f steps/s\n", session.activity.size(),
+            (session.last - session.first) / 3600, session.moveSpeed);
+
+    std::vector<Policy> policies;
+    for (double status : statusPeriods)
+        for (double position : positionPeriods)
+            for (double temperature : temperaturePeriods)
+                for (double maxPosition : maxPositionPeriods)
+                    for (double grace : graces)
+                        for (double keepalive : keepalives)
+                        {
+                            Policy policy;
+                            policy.period[TUNE_STATUS] = status;
+                            policy.period[TUNE_POSITION] = position;
+                            policy.period[TUNE_TEMPERATURE] = temperature;
+                            policy.period[TUNE_MAXPOS] = maxPosition;
+                            policy.grace = grace;
+                            policy.keepalive = keepalive;
+                            evaluate(policy, session);
+                            policy.score = wTraffic * policy.traffic + wCPU * policy.wakeups +
+                                           wLatency * policy.latency / 100 + wStaleness * policy.staleness / 10;
+                            policies.push_back(policy);
+                        }
+    std::sort(policies.begin(), policies.end(), byScore);
+
+    fprintf(stderr, "  status position  temp  maxpos grace keepalive  frames/s wakeups/s latency[ms] stale[s]  score\n");
+    for (size_t i = 0; i < policies.size() && i < TUNE_SHOW; i++)
+    {
+        const Policy &p = policies[i];
+        fprintf(stderr, "  %6.f %8.f %5.f %7.f %5.f %9.f  %8.2f %9.2f %11.1f %8.1f %6.2f\n", p.period[TUNE_STATUS], p.period[TUNE_POSITION],
+                p.period[TUNE_TEMPERATURE], p.period[TUNE_MAXPOS], p.grace, p.keepalive, p.traffic, p.wakeups, p.latency, p.staleness, p.score);
+    }
+
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if ( fp == nullptr )
+    {
+        perror(output);
+        return 1;
+    }
+    writeConfig(fp, policies[0], device);
+    if ( output )
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fakefocuser.h"
+
+FakeFocuser::FakeFocuser()
+{
+    master = slave = -1;
+    running = false;
+    position = 0;
+    count = 0;
+    scriptCommand = 0;
+    scriptDelay = 0;
+    queueHead = queueCount = 0;
+}
+
+FakeFocuser::~FakeFocuser()
+{
+    stop();
+}
+
+double FakeFocuser::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000. + ts.tv_nsec / 1e6;
+}
+
+bool FakeFocuser::start()
+{
+    struct termios tio;
+    const char *name;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ( (master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0) || ((name = ptsname(master)) == nullptr) )
+        return false;
+
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if ( (slave < 0) || (tcgetattr(slave, &tio) != 0) )
+        return false;
+    cfmakeraw(&tio);
+    if ( tcsetattr(slave, TCSANOW, &tio) != 0 )
+        return false;
+
+    running = true;
+    worker = std::thread(&FakeFocuser::run, this);
+    return true;
+}
+
+void FakeFocuser::stop()
+{
+    running = false;
+    if ( worker.joinable() )
+        worker.join();
+    if ( slave >= 0 )
+        close(slave);
+    if ( master >= 0 )
+        close(master);
+    master = slave = -1;
+}
+
+void FakeFocuser::loseNext(char k)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    scriptCommand = k;
+    scriptDelay = -1;
+}
+
+void FakeFocuser::delayNext(char k, int ms)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    scriptCommand = k;
+    scriptDelay = ms;
+}
+
+void FakeFocuser::answer(const unsigned char *request, unsigned char *reply)
+{
+    int32_t value = position;
+
+    memcpy(reply, request, 8);
+    switch (request[1])
+    {
+        case 'I':
+            // Not moving, not parked, on 12 V
+            reply[2] = reply[3] = reply[4] = 0;
+            reply[5] = 0x20;
+            break;
+        case 'W':
+            reply[2] = reply[3] = reply[4] = 0;
+            reply[5] = 1;
+            break;
+        case 'M':
+            position = (request[2] << 24) | (request[3] << 16) | (request[4] << 8) | request[5];
+            break;
+        case 'P':
+        case 'A':
+            if ( request[1] == 'A' )
+                value = 100000;
+            reply[2] = value >> 24;
+            reply[3] = value >> 16;
+            reply[4] = value >> 8;
+            reply[5] = value;
+            break;
+        case 'T':
+            // 50.0 % and 15.0 C
+            reply[2] = 500 >> 8;
+            reply[3] = 500 & 0xff;
+            reply[4] = 150 >> 8;
+            reply[5] = 150 & 0xff;
+            break;
+        case 'V':
+            reply[2] = reply[3] = reply[4] = 0;
+            reply[5] = 1;
+            break;
+    }
+    reply[7] = (reply[0] + reply[1] + reply[2] + reply[3] + reply[4] + reply[5] + reply[6]) & 0xff;
+}
+
+void FakeFocuser::run()
+{
+    unsigned char buffer[8];
+    int buffered = 0;
+
+    while ( running )
+    {
+        struct pollfd fd = { master, POLLIN, 0 };
+
+        if ( poll(&fd, 1, 2) > 0 )
+        {
+            ssize_t n = read(master, buffer + buffered, sizeof(buffer) - buffered);
+            if ( n > 0 )
+                buffered += n;
+        }
+
+        if ( buffered == sizeof(buffer) )
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            int delay = 0;
+
+            buffered = 0;
+            count++;
+            if ( buffer[1] == scriptCommand )
+            {
+                delay = scriptDelay;
+                scriptCommand = 0;
+            }
+
+            if ( (delay >= 0) && (queueCount < FAKEFOCUSER_QUEUE) )
+            {
+                Reply &reply = queue[(queueHead + queueCount) % FAKEFOCUSER_QUEUE];
+                answer(buffer, reply.frame);
+                reply.due = now() + delay;
+                queueCount++;
+            }
+        }
+
+        // In order, a late reply keeps the ones behind it waiting
+        while ( (queueCount > 0) && (queue[queueHead].due <= now()) )
+        {
+            if ( write(master, queue[queueHead].frame, 8) != 8 )
+                break;
+            queueHead = (queueHead + 1) % FAKEFOCUSER_QUEUE;
+            queueCount--;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef FAKEFOCUSER_H
+#define FAKEFOCUSER_H
+
+#include <stdint.h>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#define FAKEFOCUSER_QUEUE   64
+
+/*
+  A focuser on the other end of a pseudo terminal, for the tests. It answers
+  the driver's frames in order like the real one: status idle and absolute,
+  moves land at once. Single replies can be scripted to get lost or to come
+  late; a late reply holds back the ones behind it.
+*/
+class FakeFocuser
+{
+
+    public:
+
+        FakeFocuser();
+        ~FakeFocuser();
+
+        bool start();
+        void stop();
+
+        // The driver's end of the link
+        int fd() const { return slave; }
+
+        void setPosition(int32_t value) { position = value; }
+        unsigned long requests() const { return count; }
+
+        // The reply to the next request with command k is never sent, or sent after ms
+        void loseNext(char k);
+        void delayNext(char k, int ms);
+
+    private:
+
+        struct Reply
+        {
+            unsigned char frame[8];
+            double due;
+        };
+
+        void run();
+        void answer(const unsigned char *request, unsigned char *reply);
+        static double now();
+
+        int master;
+        int slave;
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<int32_t> position;
+        std::atomic<unsigned long> count;
+
+        std::mutex lock;
+        char scriptCommand;
+        int scriptDelay;            // ms, -1 for a lost reply
+
+        Reply queue[FAKEFOCUSER_QUEUE];
+        int queueHead;
+        int queueCount;
+};
+
+#endif
@@ -0,0 +1,394 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <thread>
+#include <system_error>
+
+#include "focuscurve.h"
+
+// Linear parameters per model once the vertex is fixed
+static const int modelParameters[FocusCurve::MODELS] = { 2, 2, 3 };
+
+// Solve the normal equations of an up to 3 parameter least squares fit
+static bool solve(double a[3][3], double b[3], int k, double *p)
+{
+    for (int i = 0; i < k; i++)
+    {
+        int pivot = i;
+        for (int r = i + 1; r < k; r++)
+            if ( fabs(a[r][i]) > fabs(a[pivot][i]) )
+                pivot = r;
+        if ( fabs(a[pivot][i]) < 1e-12 )
+            return false;
+        for (int c = 0; c < k; c++)
+        {
+            double t = a[i][c];
+            a[i][c] = a[pivot][c];
+            a[pivot][c] = t;
+        }
+        double t = b[i];
+        b[i] = b[pivot];
+        b[pivot] = t;
+
+        for (int r = i + 1; r < k; r++)
+        {
+            double f = a[r][i] / a[i][i];
+            for (int c = i; c < k; c++)
+                a[r][c] -= f * a[i][c];
+            b[r] -= f * b[i];
+        }
+    }
+    for (int i = k - 1; i >= 0; i--)
+    {
+        double s = b[i];
+        for (int c = i + 1; c < k; c++)
+            s -= a[i][c] * p[c];
+        p[i] = s / a[i][i];
+    }
+    return true;
+}
+
+// xorshift, each fitting thread keeps its own state
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t s = *state;
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return *state = s;
+}
+
+FocusCurve::FocusCurve()
+{
+    clear();
+}
+
+void FocusCurve::clear()
+{
+    count = 0;
+    lower = upper = 0;
+    best = PARABOLA;
+    for (int m = 0; m < MODELS; m++)
+        results[m].ok = false;
+}
+
+bool FocusCurve::add(double position, double hfr)
+{
+    if ( count == FOCUSCURVE_MAX_SAMPLES )
+        return false;
+    x[count] = position;
+    y[count] = hfr;
+    count++;
+    return true;
+}
+
+const char *FocusCurve::modelName(Model model)
+{
+    switch (model)
+    {
+        case PARABOLA:
+            return "parabola";
+        case HYPERBOLA:
+            return "hyperbola";
+        case ASYMMETRIC:
+            return "asymmetric hyperbola";
+        default:
+            return "none";
+    }
+}
+
+double FocusCurve::predict(Model model, const double *p, double vertex, double position) const
+{
+    double d2 = (position - vertex) * (position - vertex);
+
+    switch (model)
+    {
+        case PARABOLA:
+            return p[0] + p[1] * d2;
+        case HYPERBOLA:
+            return sqrt(fmax(0, p[0] + p[1] * d2));
+        default:
+            return sqrt(fmax(0, p[0] + (position < vertex ? p[1] : p[2]) * d2));
+    }
+}
+
+/*
+  Least squares with the vertex fixed: the parabola is linear in HFR, the
+  hyperbolas in HFR squared. Returns the sum of squared HFR residuals, or
+  DBL_MAX when the curve does not open upwards.
+*/
+double FocusCurve::profile(Model model, const int *index, int n, double vertex, double *p) const
+{
+    double a[3][3] = { { 0 } }, b[3] = { 0 }, basis[3], sse = 0;
+    int k = modelParameters[model];
+
+    for (int i = 0; i < n; i++)
+    {
+        double position = x[index[i]], hfr = y[index[i]];
+        double d2 = (position - vertex) * (position - vertex);
+        double target = model == PARABOLA ? hfr : hfr * hfr;
+
+        basis[0] = 1;
+        if ( model == ASYMMETRIC )
+        {
+            basis[1] = position < vertex ? d2 : 0;
+            basis[2] = position < vertex ? 0 : d2;
+        }
+        else
+            basis[1] = d2;
+
+        for (int r = 0; r < k; r++)
+        {
+            for (int c = 0; c < k; c++)
+                a[r][c] += basis[r] * basis[c];
+            b[r] += basis[r] * target;
+        }
+    }
+
+    if ( !solve(a, b, k, p) )
+        return DBL_MAX;
+    for (int i = 0; i < k; i++)
+        if ( p[i] <= 0 )
+            return DBL_MAX;
+
+    for (int i = 0; i < n; i++)
+    {
+        double r = y[index[i]] - predict(model, p, vertex, x[index[i]]);
+        sse += r * r;
+    }
+    return sse;
+}
+
+// Grid over the sweep and half a sweep beyond, then golden section around the best
+double FocusCurve::searchVertex(Model model, const int *index, int n, double *p) const
+{
+    const double golden = 0.618033988749895;
+    double step = (upper - lower) / (FOCUSCURVE_GRID - 1), bestVertex = lower, bestSSE = DBL_MAX;
+
+    for (int i = 0; i < FOCUSCURVE_GRID; i++)
+    {
+        double vertex = lower + i * step;
+        double sse = profile(model, index, n, vertex, p);
+        if ( sse < bestSSE )
+        {
+            bestSSE = sse;
+            bestVertex = vertex;
+        }
+    }
+
+    double a = bestVertex - step, b = bestVertex + step;
+    double c = b - golden * (b - a), d = a + golden * (b - a);
+    double fc = profile(model, index, n, c, p), fd = profile(model, index, n, d, p);
+    for (int i = 0; i < FOCUSCURVE_REFINE; i++)
+    {
+        if ( fc < fd )
+        {
+            b = d;
+            d = c;
+            fd = fc;
+            c = b - golden * (b - a);
+            fc = profile(model, index, n, c, p);
+        }
+        else
+        {
+            a = c;
+            c = d;
+            fc = fd;
+            d = a + golden * (b - a);
+            fd = profile(model, index, n, d, p);
+        }
+    }
+
+    double vertex = fc < fd ? c : d;
+    if ( fmin(fc, fd) > bestSSE )
+        vertex = bestVertex;
+    profile(model, index, n, vertex, p);
+    return vertex;
+}
+
+// Walk away from the vertex in growing steps until the profile crosses the
+// limit, then bisect the crossing
+double FocusCurve::intervalBound(Model model, const int *index, int n, double vertex, int direction, double limit) const
+{
+    double inside = vertex, outside, step = (upper - lower) / 1000, p[3];
+
+    while ( true )
+    {
+        outside = inside + direction * step;
+        if ( (outside < lower) || (outside > upper) )
+            return direction < 0 ? lower : upper;
+        if ( profile(model, index, n, outside, p) > limit )
+            break;
+        inside = outside;
+        step *= 2;
+    }
+
+    for (int i = 0; i < FOCUSCURVE_REFINE; i++)
+    {
+        double middle = (inside + outside) / 2;
+        if ( profile(model, index, n, middle, p) > limit )
+            outside = middle;
+        else
+            inside = middle;
+    }
+    return inside;
+}
+
+void FocusCurve::fitModel(Model model, double threshold)
+{
+    int k = modelParameters[model] + 1;
+    int subset[4], inliers[FOCUSCURVE_MAX_SAMPLES];
+    int bestInliers = 0, m = 0;
+    double bestCost = DBL_MAX, p[3];
+    uint32_t state = 0x9e3779b9u * (model + 1);
+    Result &result = results[model];
+
+    result.ok = false;
+
+    // Consensus from minimal subsets, ties go to the lower truncated cost
+    for (int iteration = 0; iteration < FOCUSCURVE_ITERATIONS; iteration++)
+    {
+        for (int i = 0; i < k; i++)
+        {
+            bool repeated;
+            do
+            {
+                subset[i] = next_random(&state) % count;
+                repeated = false;
+                for (int j = 0; j < i; j++)
+                    repeated |= subset[j] == subset[i];
+            }
+            while ( repeated );
+        }
+
+        double vertex = searchVertex(model, subset, k, p);
+        if ( profile(model, subset, k, vertex, p) == DBL_MAX )
+            continue;
+
+        int n = 0;
+        double cost = 0;
+        for (int i = 0; i < count; i++)
+        {
+            double r = fabs(y[i] - predict(model, p, vertex, x[i]));
+            if ( r < threshold )
+                n++;
+            cost += fmin(r, threshold) * fmin(r, threshold);
+        }
+        if ( (n > bestInliers) || ((n == bestInliers) && (cost < bestCost)) )
+        {
+            bestInliers = n;
+            bestCost = cost;
+            m = 0;
+            for (int i = 0; i < count; i++)
+                if ( fabs(y[i] - predict(model, p, vertex, x[i])) < threshold )
+                    inliers[m++] = i;
+        }
+    }
+
+    if ( m < k + 1 )
+        return;
+
+    // Final least squares on the consensus set
+    double vertex = searchVertex(model, inliers, m, p);
+    double sse = profile(model, inliers, m, vertex, p);
+    if ( sse == DBL_MAX )
+        return;
+
+    // Profile interval: vertices whose best fit is not significantly worse (F test, one parameter)
+    double limit = sse * (1 + 3.84 / fmax(1, m - k)) + 1e-12;
+    double low = intervalBound(model, inliers, m, vertex, -1, limit);
+    double high = intervalBound(model, inliers, m, vertex, 1, limit);
+
+    // Truncated cost over all samples keeps the model comparison on one sample set
+    double cost = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double r = fmin(fabs(y[i] - predict(model, p, vertex, x[i])), threshold);
+        cost += r * r;
+    }
+    cost = fmax(cost, 1e-12);
+
+    result.position = vertex;
+    result.low = low;
+    result.high = high;
+    result.hfr = predict(model, p, vertex, vertex);
+    result.rms = sqrt(sse / m);
+    result.inliers = m;
+    result.aicc = count * log(cost / count) + 2 * k + (count > k + 1 ? 2. * k * (k + 1) / (count - k - 1) : 0);
+    result.ok = true;
+}
+
+void FocusCurve::fitHelper(FocusCurve *curve, Model model, double threshold)
+{
+    curve->fitModel(model, threshold);
+}
+
+bool FocusCurve::fit(double threshold)
+{
+    double minimum = x[0], maximum = x[0];
+    std::thread workers[MODELS - 1];
+
+    if ( count < 5 )
+        return false;
+
+    for (int i = 1; i < count; i++)
+    {
+        minimum = fmin(minimum, x[i]);
+        maximum = fmax(maximum, x[i]);
+    }
+    if ( maximum <= minimum )
+        return false;
+    lower = minimum - (maximum - minimum) / 2;
+    upper = maximum + (maximum - minimum) / 2;
+
+    // One model per core, the calling thread takes the first and any model
+    // whose thread could not be started
+    for (int m = 1; m < MODELS; m++)
+    {
+        try
+        {
+            workers[m - 1] = std::thread(fitHelper, this, (Model)m, threshold);
+        }
+        catch (const std::system_error &)
+        {
+        }
+    }
+    fitModel(PARABOLA, threshold);
+    for (int m = 1; m < MODELS; m++)
+    {
+        if ( workers[m - 1].joinable() )
+            workers[m - 1].join();
+        else
+            fitModel((Model)m, threshold);
+    }
+
+    bool ok = false;
+    for (int m = 0; m < MODELS; m++)
+        if ( results[m].ok && (!ok || results[m].aicc < results[best].aicc) )
+        {
+            best = (Model)m;
+            ok = true;
+        }
+    return ok;
+}
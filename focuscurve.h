@@ -0,0 +1,96 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef FOCUSCURVE_H
+#define FOCUSCURVE_H
+
+#define FOCUSCURVE_MAX_SAMPLES  128
+#define FOCUSCURVE_ITERATIONS   64      // RANSAC subsets per model
+#define FOCUSCURVE_GRID         64      // vertex candidates before refinement
+#define FOCUSCURVE_REFINE       24      // golden section steps
+
+/*
+  Robust fit of a focus sweep. Parabola, hyperbola and an asymmetric
+  hyperbola with separate slopes on either side are fitted in parallel,
+  one thread each. Every model is linear once the vertex is fixed, so the
+  vertex is searched and the rest solved by least squares. RANSAC on
+  minimal subsets rejects frames ruined by clouds or guiding, and the
+  vertex confidence interval comes from the profile of the residuals.
+*/
+class FocusCurve
+{
+
+    public:
+
+        enum Model
+        {
+            PARABOLA,
+            HYPERBOLA,
+            ASYMMETRIC,
+            MODELS
+        };
+
+        struct Result
+        {
+            bool ok;
+            double position;        // best focus
+            double low;             // 95 % confidence interval of the position
+            double high;
+            double hfr;             // HFR at best focus
+            double rms;             // of the inliers
+            double aicc;            // model selection score, lower is better
+            int inliers;
+        };
+
+        FocusCurve();
+
+        void clear();
+        bool add(double position, double hfr);
+        int samples() const { return count; }
+
+        // Fit all models, samples further than threshold (HFR) from a model are outliers
+        bool fit(double threshold);
+
+        Model bestModel() const { return best; }
+        const Result &result(Model model) const { return results[model]; }
+        const Result &result() const { return results[best]; }
+        static const char *modelName(Model model);
+
+    private:
+
+        void fitModel(Model model, double threshold);
+        static void fitHelper(FocusCurve *curve, Model model, double threshold);
+
+        double profile(Model model, const int *index, int n, double vertex, double *p) const;
+        double searchVertex(Model model, const int *index, int n, double *p) const;
+        double intervalBound(Model model, const int *index, int n, double vertex, int direction, double limit) const;
+        double predict(Model model, const double *p, double vertex, double x) const;
+
+        double x[FOCUSCURVE_MAX_SAMPLES];
+        double y[FOCUSCURVE_MAX_SAMPLES];
+        int count;
+        double lower;
+        double upper;
+        Result results[MODELS];
+        Model best;
+};
+
+#endif
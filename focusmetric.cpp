@@ -0,0 +1,402 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+#include "focusmetric.h"
+
+#define FITS_BLOCK  2880
+#define FITS_CARD   80
+
+/*
+  Vector kernels use the GCC/Clang vector extensions. Four floats are one
+  SSE register on x86 and one NEON register on ARM; other targets get
+  plain scalar code.
+*/
+#define LANES       4
+
+typedef float v4sf __attribute__ ((vector_size (LANES * sizeof(float))));
+typedef int32_t v4si __attribute__ ((vector_size (LANES * sizeof(int32_t))));
+
+static const v4sf lane = { 0, 1, 2, 3 };
+
+static inline v4sf splat(float f)
+{
+    v4sf v = { f, f, f, f };
+    return v;
+}
+
+// Unaligned load and store
+static inline v4sf load4(const float *p)
+{
+    v4sf v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store4(float *p, v4sf v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline float sum4(v4sf v)
+{
+    return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+static inline bool any_above(const float *p, v4sf threshold)
+{
+    v4si above = load4(p) > threshold;
+    return (above[0] | above[1]) | (above[2] | above[3]);
+}
+
+// Background subtracted flux of the pixels above cut, zero for the rest
+static inline v4sf star_flux(const float *p, v4sf background, v4sf cut)
+{
+    v4sf v = load4(p);
+    return (v4sf)((v4si)(v - background) & (v > cut));
+}
+
+static void abs_deviation(float *p, size_t n, float center)
+{
+    const v4sf c = splat(center);
+    const v4si magnitude = (v4si)splat(0) | 0x7fffffff;
+    size_t i;
+
+    for (i = 0; i + LANES <= n; i += LANES)
+        store4(p + i, (v4sf)((v4si)(load4(p + i) - c) & magnitude));
+    for (; i < n; i++)
+        p[i] = fabsf(p[i] - center);
+}
+
+FocusMetric::FocusMetric()
+{
+    width = height = 0;
+    background = noise = saturation = 0;
+    startTime = duration = 0;
+    lastError[0] = '\0';
+}
+
+static bool fits_keyword(const char *card, const char *keyword)
+{
+    size_t n = strlen(keyword);
+    return !strncmp(card, keyword, n) && (card[n] == ' ' || card[n] == '=');
+}
+
+static double fits_value(const char *card)
+{
+    char value[FITS_CARD + 1];
+
+    // Value field starts after "= " in column 11
+    memcpy(value, card + 10, FITS_CARD - 10);
+    value[FITS_CARD - 10] = '\0';
+    return atof(value);
+}
+
+// DATE-OBS holds the UTC start of the exposure, e.g. '2020-03-14T21:07:33.250'
+static double fits_date(const char *card)
+{
+    struct tm t;
+    double seconds = 0;
+    const char *quote = static_cast<const char *>(memchr(card + 10, '\'', FITS_CARD - 10));
+
+    memset(&t, 0, sizeof(t));
+    if ( quote == nullptr || sscanf(quote + 1, "%4d-%2d-%2dT%2d:%2d:%lf", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &seconds) != 6 )
+        return 0;
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    return timegm(&t) + seconds;
+}
+
+// FITS data is big endian
+static inline uint16_t be16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t be32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+bool FocusMetric::loadFITS(const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    const char *card;
+    int bitpix = 0, naxis = 0, naxis1 = 0, naxis2 = 0;
+    double bzero = 0, bscale = 1;
+    size_t offset = 0;
+    bool end = false;
+
+    startTime = duration = 0;
+
+    if ( size < FITS_BLOCK || strncmp(static_cast<const char *>(data), "SIMPLE", 6) )
+    {
+        snprintf(lastError, sizeof(lastError), "Not a FITS file.");
+        return false;
+    }
+
+    while ( !end && offset + FITS_CARD <= size )
+    {
+        card = reinterpret_cast<const char *>(bytes + offset);
+        offset += FITS_CARD;
+
+        if ( fits_keyword(card, "END") )
+            end = true;
+        else if ( fits_keyword(card, "BITPIX") )
+            bitpix = fits_value(card);
+        else if ( fits_keyword(card, "NAXIS") )
+            naxis = fits_value(card);
+        else if ( fits_keyword(card, "NAXIS1") )
+            naxis1 = fits_value(card);
+        else if ( fits_keyword(card, "NAXIS2") )
+            naxis2 = fits_value(card);
+        else if ( fits_keyword(card, "BZERO") )
+            bzero = fits_value(card);
+        else if ( fits_keyword(card, "BSCALE") )
+            bscale = fits_value(card);
+        else if ( fits_keyword(card, "DATE-OBS") )
+            startTime = fits_date(card);
+        else if ( fits_keyword(card, "EXPTIME") )
+            duration = fits_value(card);
+    }
+
+    // Data starts at the next block boundary
+    offset = (offset + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+
+    if ( !end || naxis < 2 || naxis1 <= 2 * FOCUSMETRIC_RADIUS || naxis2 <= 2 * FOCUSMETRIC_RADIUS )
+    {
+        snprintf(lastError, sizeof(lastError), "Unsupported FITS image (NAXIS=%d, %dx%d).", naxis, naxis1, naxis2);
+        return false;
+    }
+
+    size_t pixels = static_cast<size_t>(naxis1) * naxis2;
+    size_t depth = abs(bitpix) / 8;
+    if ( (bitpix != 8 && bitpix != 16 && bitpix != 32 && bitpix != -32) || offset + pixels * depth > size )
+    {
+        snprintf(lastError, sizeof(lastError), "Unsupported or truncated FITS data (BITPIX=%d).", bitpix);
+        return false;
+    }
+
+    // Colour images have several planes, the first one is used
+    width = naxis1;
+    height = naxis2;
+    image.resize(pixels);
+
+    const unsigned char *p = bytes + offset;
+    float *out = image.data();
+    float scale = bscale, zero = bzero;
+    switch (bitpix)
+    {
+        case 8:
+            for (size_t i = 0; i < pixels; i++)
+                out[i] = p[i] * scale + zero;
+            saturation = 255 * scale + zero;
+            break;
+        case 16:
+            for (size_t i = 0; i < pixels; i++)
+                out[i] = static_cast<int16_t>(be16(p + 2 * i)) * scale + zero;
+            saturation = 32767 * scale + zero;
+            break;
+        case 32:
+            for (size_t i = 0; i < pixels; i++)
+                out[i] = static_cast<int32_t>(be32(p + 4 * i)) * scale + zero;
+            saturation = 2147483647. * scale + zero;
+            break;
+        case -32:
+            for (size_t i = 0; i < pixels; i++)
+            {
+                uint32_t v = be32(p + 4 * i);
+                float f;
+                memcpy(&f, &v, sizeof(f));
+                out[i] = f * scale + zero;
+            }
+            saturation = 0;
+            break;
+    }
+
+    return true;
+}
+
+void FocusMetric::load(const float *pixels, int w, int h)
+{
+    width = w;
+    height = h;
+    image.assign(pixels, pixels + static_cast<size_t>(w) * h);
+    saturation = 0;
+    startTime = duration = 0;
+}
+
+// Median and MAD of a strided sample of the frame. Stars cover a small part
+// of the sky, so the median is the background and the MAD its noise.
+void FocusMetric::estimateBackground()
+{
+    size_t pixels = image.size();
+    size_t stride = pixels / FOCUSMETRIC_SAMPLES + 1;
+    size_t n = pixels / stride;
+
+    sample.resize(n);
+    for (size_t i = 0; i < n; i++)
+        sample[i] = image[i * stride];
+
+    std::nth_element(sample.begin(), sample.begin() + n / 2, sample.end());
+    background = sample[n / 2];
+
+    abs_deviation(sample.data(), n, background);
+    std::nth_element(sample.begin(), sample.begin() + n / 2, sample.end());
+    noise = 1.4826f * sample[n / 2];
+    if ( noise < 1e-3f )
+        noise = 1e-3f;
+}
+
+// Half flux radius around a detected peak: flux weighted mean distance from
+// the centroid, with the background removed. Only pixels clearly above the
+// sky count; clipped sky noise over the whole window would otherwise put a
+// floor under the radius of sharp stars.
+// The window rows are taken four pixels at a time, the rest of a row is scalar.
+double FocusMetric::starHFR(int x, int y)
+{
+    const int r = FOCUSMETRIC_RADIUS, n = 2 * r + 1;
+    const float cut = background + FOCUSMETRIC_FLUX_SIGMA * noise;
+    const v4sf bg = splat(background), vcut = splat(cut);
+    v4sf vsum = splat(0), vsx = splat(0), vsy = splat(0), vsr = splat(0);
+    double sum = 0, sx = 0, sy = 0, sr = 0;
+    int i;
+
+    for (int j = -r; j <= r; j++)
+    {
+        const float *row = &image[static_cast<size_t>(y + j) * width + x - r];
+        for (i = 0; i + LANES <= n; i += LANES)
+        {
+            v4sf f = star_flux(row + i, bg, vcut);
+            vsum += f;
+            vsx += f * (lane + splat(i - r));
+            vsy += f * splat(j);
+        }
+        for (; i < n; i++)
+        {
+            float f = row[i] - background;
+            if ( row[i] > cut )
+            {
+                sum += f;
+                sx += f * (i - r);
+                sy += f * j;
+            }
+        }
+    }
+    sum += sum4(vsum);
+    sx += sum4(vsx);
+    sy += sum4(vsy);
+    if ( sum <= 0 )
+        return 0;
+
+    double cx = sx / sum, cy = sy / sum;
+    for (int j = -r; j <= r; j++)
+    {
+        const float *row = &image[static_cast<size_t>(y + j) * width + x - r];
+        const v4sf dy = splat(j - cy);
+        for (i = 0; i + LANES <= n; i += LANES)
+        {
+            v4sf dx = lane + splat(i - r - cx);
+            v4sf d = dx * dx + dy * dy;
+            for (int k = 0; k < LANES; k++)
+                d[k] = sqrtf(d[k]);
+            vsr += star_flux(row + i, bg, vcut) * d;
+        }
+        for (; i < n; i++)
+        {
+            float f = row[i] - background;
+            if ( row[i] > cut )
+                sr += f * sqrt((i - r - cx) * (i - r - cx) + (j - cy) * (j - cy));
+        }
+    }
+    sr += sum4(vsr);
+    return sr / sum;
+}
+
+double FocusMetric::measureHFR(int *stars)
+{
+    const int r = FOCUSMETRIC_RADIUS;
+
+    hfrs.clear();
+    candidates.clear();
+    if ( stars )
+        *stars = 0;
+    if ( image.empty() )
+        return 0;
+
+    estimateBackground();
+    float threshold = background + FOCUSMETRIC_SIGMA * noise;
+    const v4sf vthreshold = splat(threshold);
+
+    // Candidate pixels: above the threshold and the maximum of their 3x3 neighbourhood
+    for (int y = r; y < height - r; y++)
+    {
+        const float *row = &image[static_cast<size_t>(y) * width];
+        for (int x = r; x < width - r; x++)
+        {
+            // Most of a frame is sky, it is passed over four pixels at a time
+            if ( (x + LANES <= width - r) && !any_above(row + x, vthreshold) )
+            {
+                x += LANES - 1;
+                continue;
+            }
+
+            float v = row[x];
+            if ( v <= threshold )
+                continue;
+            if ( v < row[x - 1] || v <= row[x + 1] ||
+                    v < row[x - width - 1] || v < row[x - width] || v < row[x - width + 1] ||
+                    v <= row[x + width - 1] || v <= row[x + width] || v <= row[x + width + 1] )
+                continue;
+            // Skip saturated cores, their profile is clipped
+            if ( saturation > 0 && v >= 0.95f * saturation )
+                continue;
+            candidates.push_back(y * width + x);
+            if ( static_cast<int>(candidates.size()) >= FOCUSMETRIC_MAX_STARS )
+                break;
+        }
+        if ( static_cast<int>(candidates.size()) >= FOCUSMETRIC_MAX_STARS )
+            break;
+    }
+
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        double hfr = starHFR(candidates[i] % width, candidates[i] / width);
+        // Hot pixels and cosmic rays are sharper than any star
+        if ( hfr > 0.5 )
+            hfrs.push_back(hfr);
+    }
+
+    if ( hfrs.empty() )
+        return 0;
+
+    if ( stars )
+        *stars = hfrs.size();
+    std::nth_element(hfrs.begin(), hfrs.begin() + hfrs.size() / 2, hfrs.end());
+    return hfrs[hfrs.size() / 2];
+}
@@ -0,0 +1,83 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef FOCUSMETRIC_H
+#define FOCUSMETRIC_H
+
+#include <stddef.h>
+#include <vector>
+
+#define FOCUSMETRIC_RADIUS      10      // star window half size [px]
+#define FOCUSMETRIC_SIGMA       5.0     // detection threshold above background
+#define FOCUSMETRIC_FLUX_SIGMA  3.0     // pixels above this many noise sigmas count as star flux
+#define FOCUSMETRIC_MAX_STARS   512
+#define FOCUSMETRIC_SAMPLES     65536   // pixels sampled for background statistics
+
+/*
+  Star detection and half flux radius of a single frame. The frame buffers
+  are kept between calls, so a stream of equally sized frames does not
+  allocate. The sky scan, the background statistics and the star moments
+  run as four lane vector kernels (SSE on x86, NEON on ARM).
+*/
+class FocusMetric
+{
+
+    public:
+
+        FocusMetric();
+
+        // Load the primary image of a FITS file (BITPIX 8, 16, 32 or -32)
+        bool loadFITS(const void *data, size_t size);
+
+        // Load a frame of raw pixels
+        void load(const float *pixels, int width, int height);
+
+        // Median half flux radius of the detected stars in pixels, 0 if none
+        double measureHFR(int *stars = nullptr);
+
+        // Exposure start from DATE-OBS as UNIX time and EXPTIME in seconds, 0 if not in the header
+        double exposureStart() const { return startTime; }
+        double exposureTime() const { return duration; }
+
+        const char *error() const { return lastError; }
+        int frameWidth() const { return width; }
+        int frameHeight() const { return height; }
+
+    private:
+
+        void estimateBackground();
+        double starHFR(int x, int y);
+
+        std::vector<float> image;
+        std::vector<float> sample;
+        std::vector<float> hfrs;
+        std::vector<int> candidates;
+        int width;
+        int height;
+        float background;
+        float noise;
+        float saturation;
+        double startTime;
+        double duration;
+        char lastError[128];
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+  Focus metric benchmark. Renders synthetic star fields of Gaussian stars
+  on a noisy sky, writes them as 16 bit FITS and times loading and HFR
+  measurement the way the driver does for a snooped image. The measured
+  HFR is compared with the exact value for the Gaussian profile,
+  sigma * sqrt(pi / 2), and the run fails when it is further off than the
+  relative tolerance.
+
+  Usage: focusmetric_bench [-w width] [-h height] [-n stars] [-s sigma] [-r repeats] [-t tolerance]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "focusmetric.h"
+
+#define SKY         1000.0      // background level [ADU]
+#define PEAK        8000.0      // star peak above the sky [ADU]
+#define READ_NOISE  10.0        // [ADU]
+#define TOLERANCE   0.05        // relative HFR error accepted
+
+static uint32_t rng = 2463534242u;
+
+// xorshift32, uniform in (0, 1]
+static double uniform()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (rng + 1.0) / 4294967296.0;
+}
+
+static double gaussian()
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void card(std::vector<char> &header, const char *format, ...)
+{
+    char line[81];
+    va_list ap;
+
+    va_start(ap, format);
+    vsnprintf(line, sizeof(line), format, ap);
+    va_end(ap);
+    size_t n = strlen(line);
+    memset(line + n, ' ', 80 - n);
+    header.insert(header.end(), line, line + 80);
+}
+
+// 16 bit FITS with BZERO 32768, as most cameras write it
+static std::vector<unsigned char> render(int width, int height, int stars, double sigma)
+{
+    std::vector<float> sky(static_cast<size_t>(width) * height);
+    std::vector<char> header;
+    int r = ceil(5 * sigma);
+
+    for (size_t i = 0; i < sky.size(); i++)
+        sky[i] = SKY + sqrt(SKY) * gaussian() + READ_NOISE * gaussian();
+
+    for (int s = 0; s < stars; s++)
+    {
+        double cx = r + FOCUSMETRIC_RADIUS + uniform() * (width - 2 * (r + FOCUSMETRIC_RADIUS));
+        double cy = r + FOCUSMETRIC_RADIUS + uniform() * (height - 2 * (r + FOCUSMETRIC_RADIUS));
+        double peak = PEAK * (0.3 + 0.7 * uniform());
+        for (int y = cy - r; y <= cy + r; y++)
+            for (int x = cx - r; x <= cx + r; x++)
+                sky[static_cast<size_t>(y) * width + x] += peak * exp(-((x - cx) * (x - cx) + (y - cy) * (y - cy)) / (2 * sigma * sigma));
+    }
+
+    card(header, "SIMPLE  = %20s", "T");
+    card(header, "BITPIX  = %20d", 16);
+    card(header, "NAXIS   = %20d", 2);
+    card(header, "NAXIS1  = %20d", width);
+    card(header, "NAXIS2  = %20d", height);
+    card(header, "BZERO   = %20d", 32768);
+    card(header, "BSCALE  = %20d", 1);
+    card(header, "END");
+    header.resize((header.size() + 2879) / 2880 * 2880, ' ');
+
+    std::vector<unsigned char> fits(header.begin(), header.end());
+    fits.resize(header.size() + ((sky.size() * 2 + 2879) / 2880 * 2880), 0);
+    unsigned char *p = &fits[header.size()];
+    for (size_t i = 0; i < sky.size(); i++)
+    {
+        long v = lround(sky[i]);
+        v = v < 0 ? 0 : (v > 65535 ? 65535 : v);
+        int16_t stored = v - 32768;
+        p[2 * i] = static_cast<uint16_t>(stored) >> 8;
+        p[2 * i + 1] = stored & 0xff;
+    }
+    return fits;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-w width] [-h height] [-n stars] [-s sigma] [-r repeats] [-t tolerance]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 1280, height = 960, stars = 100, repeats = 20, opt;
+    double sigma = 0, tolerance = TOLERANCE;
+    bool ok = true;
+
+    while ( (opt = getopt(argc, argv, "w:h:n:s:r:t:")) != -1 )
+    {
+        switch (opt)
+        {
+            case 'w': width = atoi(optarg); break;
+            case 'h': height = atoi(optarg); break;
+            case 'n': stars = atoi(optarg); break;
+            case 's': sigma = atof(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 't': tolerance = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if ( width <= 4 * FOCUSMETRIC_RADIUS || height <= 4 * FOCUSMETRIC_RADIUS || stars < 1 || repeats < 1 )
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Without -s a focus sweep's range of star sizes is measured
+    const double sweep[] = { 1.0, 1.5, 2.0, 3.0 };
+    int sigmas = sigma > 0 ? 1 : sizeof(sweep) / sizeof(sweep[0]);
+    FocusMetric metric;
+
+    printf("%dx%d, %d stars, %d repeats\n", width, height, stars, repeats);
+    printf("%8s %10s %10s %8s %8s %10s %10s\n", "sigma", "expected", "HFR", "error", "stars", "load [ms]", "HFR [ms]");
+    for (int k = 0; k < sigmas; k++)
+    {
+        double s = sigma > 0 ? sigma : sweep[k];
+        std::vector<unsigned char> fits = render(width, height, stars, s);
+        double load = 0, measure = 0, hfr = 0;
+        int found = 0;
+
+        for (int i = 0; i < repeats; i++)
+        {
+            double start = now_ms();
+            if ( !metric.loadFITS(fits.data(), fits.size()) )
+            {
+                fprintf(stderr, "%s\n", metric.error());
+                return 1;
+            }
+            double loaded = now_ms();
+            hfr = metric.measureHFR(&found);
+            measure += now_ms() - loaded;
+            load += loaded - start;
+        }
+
+        double expected = s * sqrt(M_PI / 2), error = (hfr - expected) / expected;
+        bool within = fabs(error) <= tolerance;
+        printf("%8.2f %10.3f %10.3f %+7.1f%% %8d %10.3f %10.3f%s\n", s, expected, hfr, 100 * error, found, load / repeats,
+               measure / repeats, within ? "" : "  out of tolerance");
+        ok &= within;
+    }
+
+    return ok ? 0 : 1;
+}
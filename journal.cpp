@@ -0,0 +1,153 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+Journal::Journal()
+{
+    file = nullptr;
+    count = 0;
+}
+
+Journal::~Journal()
+{
+    close();
+}
+
+bool Journal::open(const char *path)
+{
+    uint32_t size = sizeof(JournalRecord);
+    long end;
+
+    close();
+    file = fopen(path, "ab");
+    if ( file == nullptr )
+        return false;
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+    // A new file gets the header, an existing one is appended to
+    fseek(file, 0, SEEK_END);
+    end = ftell(file);
+    if ( end == 0 )
+    {
+        fwrite(JOURNAL_MAGIC, 1, 4, file);
+        fwrite(&size, sizeof(size), 1, file);
+    }
+    count = 0;
+    return true;
+}
+
+void Journal::close()
+{
+    if ( file == nullptr )
+        return;
+    fclose(file);
+    file = nullptr;
+}
+
+void Journal::flush()
+{
+    if ( file != nullptr )
+        fflush(file);
+}
+
+void Journal::write(JournalType type, double time, char command, uint8_t status, int32_t position, float value, float extra)
+{
+    JournalRecord record;
+
+    if ( file == nullptr )
+        return;
+
+    memset(&record, 0, sizeof(record));
+    record.time = time;
+    record.type = type;
+    record.command = command;
+    record.status = status;
+    record.position = position;
+    record.value = value;
+    record.extra = extra;
+    if ( fwrite(&record, sizeof(record), 1, file) == 1 )
+        count++;
+}
+
+// Slide a memory mapped window over whole records, so journals of any size
+// are streamed with constant memory
+bool Journal::scan(const char *path, Reader reader, void *context)
+{
+    char magic[4];
+    uint32_t size;
+    struct stat st;
+    long page = sysconf(_SC_PAGESIZE);
+    int fd = ::open(path, O_RDONLY);
+
+    if ( fd < 0 )
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if ( (fstat(fd, &st) < 0) || (read(fd, magic, 4) != 4) || (read(fd, &size, 4) != 4) ||
+            memcmp(magic, JOURNAL_MAGIC, 4) || (size != sizeof(JournalRecord)) )
+    {
+        fprintf(stderr, "%s: not a DreamFocuser journal\n", path);
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping has to start on a page boundary
+    off_t offset = 8, end = 8 + (st.st_size - 8) / size * size;
+    off_t window = JOURNAL_WINDOW / size * size;
+    while ( offset < end )
+    {
+        off_t aligned = offset & ~(off_t)(page - 1);
+        size_t length = (offset - aligned) + (end - offset < window ? end - offset : window);
+        void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, aligned);
+        if ( map == MAP_FAILED )
+        {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+
+        const char *data = static_cast<const char *>(map) + (offset - aligned);
+        size_t n = (length - (offset - aligned)) / size;
+        for (size_t i = 0; i < n; i++)
+        {
+            JournalRecord record;
+            memcpy(&record, data + i * size, size);
+            reader(record, context);
+        }
+
+        munmap(map, length);
+        offset += n * size;
+    }
+
+    ::close(fd);
+    return true;
+}
@@ -0,0 +1,90 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC       "DFJ1"
+#define JOURNAL_BUFFER      65536
+#define JOURNAL_WINDOW      (64 << 20)  // bytes mapped at once when reading
+
+enum JournalType
+{
+    JOURNAL_COMMAND,        // command, status, value latency [ms]
+    JOURNAL_MOVE,           // position distance, status retries, value duration [ms], extra of it spent noticing the arrival [ms]
+    JOURNAL_FOCUS,          // position, value temperature [C], extra HFR [px]
+    JOURNAL_TICK,           // value duration of one scheduler tick [ms]
+    JOURNAL_PARK            // park or unpark command, status park state before, position
+};
+
+/*
+  Fixed size little endian records behind a 8 byte header (magic and record
+  size), so the analyzer can walk a mapped file without parsing.
+*/
+struct JournalRecord
+{
+    double time;            // UNIX seconds
+    uint8_t type;
+    char command;
+    uint8_t status;
+    uint8_t reserved;
+    int32_t position;
+    float value;
+    float extra;
+};
+
+/*
+  Append only journal of link, motion and focus events for offline analysis.
+  Writes go through a stdio buffer opened once, so logging does not allocate
+  or hit the disk on every record.
+*/
+class Journal
+{
+
+    public:
+
+        Journal();
+        ~Journal();
+
+        bool open(const char *path);
+        void close();
+        void flush();
+        bool isOpen() const { return file != nullptr; }
+        unsigned long records() const { return count; }
+
+        void write(JournalType type, double time, char command, uint8_t status, int32_t position, float value, float extra = 0);
+
+        typedef void (*Reader)(const JournalRecord &record, void *context);
+
+        // Stream every record of a journal through reader, false with a message on stderr on failure
+        static bool scan(const char *path, Reader reader, void *context);
+
+    private:
+
+        FILE *file;
+        char buffer[JOURNAL_BUFFER];
+        unsigned long count;
+};
+
+#endif
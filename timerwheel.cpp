@@ -0,0 +1,193 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <time.h>
+
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel()
+{
+    current = 0;
+    for (int level = 0; level < TIMERWHEEL_LEVELS; level++)
+        for (int i = 0; i < TIMERWHEEL_SLOTS; i++)
+            slots[level][i] = nullptr;
+}
+
+uint64_t TimerWheel::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+void TimerWheel::start()
+{
+    clear();
+    current = now() / TIMERWHEEL_RESOLUTION;
+}
+
+void TimerWheel::clear()
+{
+    for (int level = 0; level < TIMERWHEEL_LEVELS; level++)
+        for (int i = 0; i < TIMERWHEEL_SLOTS; i++)
+            while ( slots[level][i] != nullptr )
+                unlink(slots[level][i]);
+}
+
+void TimerWheel::schedule(Task *task, uint32_t delayMs, uint32_t periodMs)
+{
+    if ( task->slot != nullptr )
+        unlink(task);
+
+    task->period = periodMs;
+    task->deadline = (now() + delayMs + TIMERWHEEL_RESOLUTION - 1) / TIMERWHEEL_RESOLUTION;
+    insert(task);
+}
+
+void TimerWheel::cancel(Task *task)
+{
+    if ( task->slot != nullptr )
+        unlink(task);
+}
+
+void TimerWheel::insert(Task *task)
+{
+    uint64_t deadline = task->deadline > current ? task->deadline : current + 1;
+    uint64_t delta = deadline - current;
+    Task **slot;
+
+    if ( delta < TIMERWHEEL_SLOTS )
+        slot = &slots[0][deadline & TIMERWHEEL_MASK];
+    else if ( delta < (1ULL << (2 * TIMERWHEEL_BITS)) )
+        slot = &slots[1][(deadline >> TIMERWHEEL_BITS) & TIMERWHEEL_MASK];
+    else
+    {
+        // Beyond the wheel, park it in the farthest slot, it is re-inserted on cascade
+        if ( delta >= (1ULL << (3 * TIMERWHEEL_BITS)) )
+            deadline = current + (1ULL << (3 * TIMERWHEEL_BITS)) - 1;
+        slot = &slots[2][(deadline >> (2 * TIMERWHEEL_BITS)) & TIMERWHEEL_MASK];
+    }
+
+    task->slot = slot;
+    task->prev = nullptr;
+    task->next = *slot;
+    if ( *slot != nullptr )
+        (*slot)->prev = task;
+    *slot = task;
+}
+
+void TimerWheel::unlink(Task *task)
+{
+    if ( task->prev != nullptr )
+        task->prev->next = task->next;
+    else
+        *task->slot = task->next;
+    if ( task->next != nullptr )
+        task->next->prev = task->prev;
+
+    task->prev = task->next = nullptr;
+    task->slot = nullptr;
+}
+
+// Move the tasks of the current slot of a higher level down the wheel.
+// Returns the slot index, 0 means the next level has to cascade as well.
+int TimerWheel::cascade(int level)
+{
+    int index = (current >> (level * TIMERWHEEL_BITS)) & TIMERWHEEL_MASK;
+    Task *task = slots[level][index];
+
+    slots[level][index] = nullptr;
+    while ( task != nullptr )
+    {
+        Task *next = task->next;
+        task->slot = nullptr;
+        insert(task);
+        task = next;
+    }
+    return index;
+}
+
+void TimerWheel::advance()
+{
+    uint64_t target = now() / TIMERWHEEL_RESOLUTION;
+
+    while ( current < target )
+    {
+        current++;
+
+        int index = current & TIMERWHEEL_MASK;
+        if ( index == 0 && cascade(1) == 0 )
+            cascade(2);
+
+        // Periodic tasks are re-armed before running, so the callback may cancel them
+        Task **slot = &slots[0][index];
+        while ( *slot != nullptr )
+        {
+            Task *task = *slot;
+            unlink(task);
+            if ( task->deadline > current )
+            {
+                // Parked from beyond the wheel range, not due yet
+                insert(task);
+                continue;
+            }
+            if ( task->period > 0 )
+            {
+                task->deadline += (task->period + TIMERWHEEL_RESOLUTION - 1) / TIMERWHEEL_RESOLUTION;
+                insert(task);
+            }
+            task->callback(task->context);
+        }
+    }
+}
+
+int64_t TimerWheel::nextDelay() const
+{
+    uint64_t nearest = 0;
+    bool found = false;
+
+    for (int i = 1; i <= TIMERWHEEL_SLOTS && !found; i++)
+        if ( slots[0][(current + i) & TIMERWHEEL_MASK] != nullptr )
+        {
+            nearest = current + i;
+            found = true;
+        }
+
+    // Higher levels only hold a handful of long period tasks, a scan is cheap
+    for (int level = 1; level < TIMERWHEEL_LEVELS; level++)
+        for (int i = 0; i < TIMERWHEEL_SLOTS; i++)
+            for (Task *task = slots[level][i]; task != nullptr; task = task->next)
+            {
+                // Parked tasks have to be woken at their cascade point to be re-inserted
+                uint64_t wake = task->deadline;
+                if ( wake - current >= (1ULL << (3 * TIMERWHEEL_BITS)) )
+                    wake = current + (1ULL << (3 * TIMERWHEEL_BITS)) - 1;
+                if ( !found || wake < nearest )
+                    nearest = wake;
+                found = true;
+            }
+
+    if ( !found )
+        return -1;
+
+    int64_t delay = static_cast<int64_t>(nearest * TIMERWHEEL_RESOLUTION) - static_cast<int64_t>(now());
+    return delay > 0 ? delay : 0;
+}
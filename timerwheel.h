@@ -0,0 +1,86 @@
+/*
+  INDI Driver for DreamFocuser
+
+  Copyright (C) 2016 Piotr Dlugosz
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+#define TIMERWHEEL_RESOLUTION   10      // ms per tick
+#define TIMERWHEEL_LEVELS       3
+#define TIMERWHEEL_BITS         6
+#define TIMERWHEEL_SLOTS        (1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_MASK         (TIMERWHEEL_SLOTS - 1)
+
+/*
+  Hierarchical timer wheel. Tasks are owned by the caller and linked into
+  the wheel, so scheduling never allocates. Insert and cancel are O(1);
+  level 0 covers 640 ms in 10 ms slots, level 1 about 41 s and level 2
+  about 44 min. Longer delays are parked in the last level and re-inserted
+  when they cascade down.
+*/
+class TimerWheel
+{
+
+    public:
+
+        typedef void (*Callback)(void *context);
+
+        struct Task
+        {
+            Callback callback = nullptr;
+            void *context = nullptr;
+            uint32_t period = 0;
+            uint64_t deadline = 0;
+            Task *prev = nullptr;
+            Task *next = nullptr;
+            Task **slot = nullptr;
+        };
+
+        TimerWheel();
+
+        static uint64_t now();
+
+        void start();
+        void clear();
+
+        // Run callback after delayMs, then every periodMs unless it is 0
+        void schedule(Task *task, uint32_t delayMs, uint32_t periodMs = 0);
+        void cancel(Task *task);
+        bool isScheduled(const Task *task) const { return task->slot != nullptr; }
+
+        // Run all tasks that are due by now
+        void advance();
+
+        // Milliseconds until the nearest deadline, -1 if nothing is scheduled
+        int64_t nextDelay() const;
+
+    private:
+
+        void insert(Task *task);
+        void unlink(Task *task);
+        int cascade(int level);
+
+        Task *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+        uint64_t current;
+};
+
+#endif